@@ -0,0 +1,36 @@
+
+
+local luview = require 'luview'
+local shaders = require 'shaders'
+
+local window = luview.Window()
+local frames = luview.TimeSeriesSource()
+local verts = luview.ParametricVertexSource3D()
+local triangles = luview.TrianglesEnsemble()
+local pyluts = luview.MatplotlibColormaps()
+local lights = shaders.load_shader("multlights")
+
+-- usage: lua checkpoints.lua chkpt.0000.h5 chkpt.0001.h5 ...
+for n=1,#arg do
+   frames:add_frame(arg[n], "prim/pre")
+end
+frames:set_window(2, 4)
+
+verts:set_input(frames)
+
+mesh = verts:get_output("mesh")
+mesh:set_normalize(true)
+
+triangles:set_data("mesh", mesh)
+triangles:set_data("color_table", pyluts)
+triangles:set_shader(lights)
+triangles:set_orientation(-90,0,0)
+triangles:set_scale(1.0, 0.04, 1.0)
+window:set_color(0,0,0.05)
+
+pyluts:set_colormap("afmhot")
+window:set_callback("]", function() pyluts:next_colormap() end, "next colormap")
+window:set_callback("[", function() pyluts:prev_colormap() end, "previous colormap")
+window:set_callback(".", function() frames:next_frame() end, "next checkpoint")
+window:set_callback(",", function() frames:prev_frame() end, "previous checkpoint")
+while window:render_scene{triangles} == "continue" do end
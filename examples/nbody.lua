@@ -25,6 +25,14 @@ box:set_color(0.7, 0.9, 0.9)
 box:set_shader(shader)
 box:set_alpha(0.9)
 
+window:set_callback("o", function()
+   if window:get_render_mode() == "oit" then
+      window:set_render_mode("blend")
+   else
+      window:set_render_mode("oit")
+   end
+end, "toggle order independent transparency")
+
 local status = "continue"
 local key = ''
 local lambda = 3.6
@@ -9,7 +9,7 @@ local window = luview.Window()
 local box = luview.BoundingBox()
 local height = luview.DataSource()
 local verts = luview.ParametricVertexSource3D()
-local triangles = luview.TrianglesEnsemble()
+local triangles = luview.TerrainSurface()
 local points = luview.DataSource()
 local surfshd = luview.ShaderProgram()
 local pyluts = luview.MatplotlibColormaps()
@@ -57,8 +57,8 @@ h5_close_file()
 height:set_data(data)
 verts:set_input(height)
 
-scalars = verts:get_output("scalars")
-scalars:set_normalize(true)
+mesh = verts:get_output("mesh")
+mesh:set_normalize(true)
 
 triangles.inc_scale = function(self)
    local hx, hy, hz = self:get_scale()
@@ -71,10 +71,9 @@ triangles.dec_scale = function(self)
    self:set_scale(hx, hy, hz)
 end
 
-triangles:set_data("triangles", verts:get_output("triangles"))
-triangles:set_data("normals", verts:get_output("normals"))
+triangles:set_data("mesh", mesh)
 triangles:set_data("color_table", pyluts)
-triangles:set_data("scalars", scalars)
+triangles:set_tolerance(1.0)
 triangles:set_shader(surfshd)
 triangles:set_alpha(1.0)
 triangles:set_color(0.3, 0.8, 0.3)
@@ -89,5 +88,8 @@ window:set_callback("]", function() pyluts:next_colormap() end, "next colormap")
 window:set_callback("[", function() pyluts:prev_colormap() end, "previous colormap")
 window:set_callback("H", function() triangles:inc_scale() end, "increase scale height")
 window:set_callback("h", function() triangles:dec_scale() end, "decrease scale height")
+window:set_callback("t", function()
+   print(triangles:get_num_triangles() .. " triangles drawn") end,
+   "print the number of triangles drawn")
 while window:render_scene{triangles} == "continue" do end
 
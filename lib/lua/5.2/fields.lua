@@ -0,0 +1,33 @@
+-- Scalar fields and color tables for the test scripts and examples. Fields
+-- fill the unit cube centered on the origin as the volume artists and sources
+-- expect, with x along the last axis of the array and z along its first.
+
+local lunum = require 'lunum'
+
+local function sample(N, f)
+   -- an (N,N,N) array of f(x,y,z) at the centers of the voxels
+   local a = lunum.zeros{N,N,N}
+   for m=0,N*N*N-1 do
+      local i, j, k = math.floor(m/(N*N)), math.floor(m/N) % N, m % N
+      a[m] = f((k+0.5)/N - 0.5, (j+0.5)/N - 0.5, (i+0.5)/N - 0.5)
+   end
+   return a
+end
+
+local function ramp(cutoff)
+   -- blue through red, and transparent below the cutoff
+   local lut = lunum.zeros{256,4}
+   for n=0,255 do
+      local u = n/255
+      lut[4*n+0] = u
+      lut[4*n+1] = 1 - math.abs(2*u - 1)
+      lut[4*n+2] = 1 - u
+      lut[4*n+3] = u < cutoff and 0 or u
+   end
+   return lut
+end
+
+return {
+   sample=sample,
+   ramp=ramp
+}
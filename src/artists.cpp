@@ -2,35 +2,190 @@
 
 #include "luview.hpp"
 #include <cmath>
+#include <algorithm>
 
-template <class T> static void draw_cylinder(const T *x0, const T *x1, T rad0, T rad1)
+#define __CYLINDER_STRIDE 6 // interleaved position and normal
+
+
+struct VertexStream
+{
+  GLenum array; // e.g. GL_VERTEX_ARRAY
+  GLuint vbo;
+  GLint size; // number of components
+  GLsizei stride;
+  size_t offset; // of the first vertex, in bytes
+} ;
+
+static void draw_indexed(GLenum mode, DataSource *ind,
+                         const VertexStream *streams, int nstreams)
+// -----------------------------------------------------------------------------
+// Draws the indices of `ind` one meshlet at a time, pointing each of the
+// vertex streams at the meshlet's base vertex first. The client states of the
+// streams must already be enabled.
+// -----------------------------------------------------------------------------
 {
-  T r[3] = {x1[0] - x0[0], x1[1] - x0[1], x1[2] - x0[2]};
-  T mag = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
-  r[0] /= mag;
-  r[1] /= mag;
-  r[2] /= mag;
+  const std::vector<DataSource::Meshlet> &parts = ind->get_meshlets();
+  const GLenum type = ind->get_index_type();
+  const size_t isz = type == GL_UNSIGNED_SHORT ? sizeof(GLushort) :
+    sizeof(GLuint);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ind->get_ibo());
+  for (unsigned int n=0; n<parts.size(); ++n) {
+    for (int k=0; k<nstreams; ++k) {
+      const VertexStream &s = streams[k];
+      const GLvoid *p = (GLvoid*) (s.offset + (size_t) parts[n].base*s.stride);
+      glBindBuffer(GL_ARRAY_BUFFER, s.vbo);
+      switch (s.array) {
+      case GL_VERTEX_ARRAY: glVertexPointer(s.size, GL_FLOAT, s.stride, p);
+        break;
+      case GL_NORMAL_ARRAY: glNormalPointer(GL_FLOAT, s.stride, p);
+        break;
+      case GL_COLOR_ARRAY: glColorPointer(s.size, GL_FLOAT, s.stride, p);
+        break;
+      case GL_TEXTURE_COORD_ARRAY: glTexCoordPointer(s.size, GL_FLOAT,
+                                                     s.stride, p);
+        break;
+      }
+    }
+    glDrawElements(mode, parts[n].count, type, (GLvoid*) (parts[n].first*isz));
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-  T a[3], zhat[3] = { 0, 0, 1 };
-  a[0] = zhat[1]*r[2] - zhat[2]*r[1];
-  a[1] = zhat[2]*r[0] - zhat[0]*r[2];
-  a[2] = zhat[0]*r[1] - zhat[1]*r[0];
 
-  T angle = acos(r[2]) * 180.0 / M_PI;
+static const std::vector<GLfloat> &unit_cylinder(int slices)
+// -----------------------------------------------------------------------------
+// Returns the ring of 2*(slices+1) vertices of a cylinder of unit radius along
+// the z-axis from 0 to 1, as (cos, sin, z) triples. Built once per number of
+// slices.
+// -----------------------------------------------------------------------------
+{
+  static std::map<int, std::vector<GLfloat> > cache;
+  std::vector<GLfloat> &ring = cache[slices];
+
+  if (ring.empty()) {
+    ring.resize(6*(slices + 1));
+    for (int s=0; s<=slices; ++s) {
+      const double theta = 2 * M_PI * s / slices;
+      for (int h=0; h<2; ++h) {
+        GLfloat *r = &ring[3*(2*s + h)];
+        r[0] = cos(theta);
+        r[1] = sin(theta);
+        r[2] = h;
+      }
+    }
+  }
+  return ring;
+}
 
-  glPushMatrix();
-  glTranslated(x0[0], x0[1], x0[2]);
-  glRotated(angle, a[0], a[1], a[2]);
 
-  GLUquadric *quad = gluNewQuadric();
-  gluCylinder(quad, rad0, rad1, mag, 72, 1);
-  gluDeleteQuadric(quad);
+CylinderBatch::CylinderBatch(int slices) : slices(slices), num_indices(0)
+{
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+}
+CylinderBatch::~CylinderBatch()
+{
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+}
+void CylinderBatch::build(const GLfloat *verts, const GLuint *indices, int nseg,
+                          GLfloat radius)
+// -----------------------------------------------------------------------------
+// Places a copy of the unit cylinder along each of the `nseg` segments, whose
+// end points are verts[3*indices[2*n]] and verts[3*indices[2*n+1]].
+// -----------------------------------------------------------------------------
+{
+  const std::vector<GLfloat> &ring = unit_cylinder(slices);
+  const int nv = 2*(slices + 1); // vertices per cylinder
+  const int ni = 6*slices; // indices per cylinder
+  std::vector<GLfloat> V((size_t) nseg * nv * __CYLINDER_STRIDE);
+  std::vector<GLuint> I((size_t) nseg * ni);
+
+#pragma omp parallel for schedule(static)
+  for (int n=0; n<nseg; ++n) {
+    const GLfloat *x0 = &verts[3*indices[2*n + 0]];
+    const GLfloat *x1 = &verts[3*indices[2*n + 1]];
+    GLfloat r[3] = {x1[0] - x0[0], x1[1] - x0[1], x1[2] - x0[2]};
+    GLfloat mag = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+
+    if (mag > 0) {
+      r[0] /= mag;
+      r[1] /= mag;
+      r[2] /= mag;
+    }
+    else {
+      r[0] = 0; r[1] = 0; r[2] = 1;
+    }
+
+    // Orthonormal frame (e1, e2, r) around the segment, seeded with whichever
+    // axis is further from being parallel to it.
+    GLfloat a[3] = { 0, 0, 0 };
+    a[fabs(r[2]) < 0.9 ? 2 : 0] = 1;
+    GLfloat e1[3], e2[3];
+    e1[0] = a[1]*r[2] - a[2]*r[1];
+    e1[1] = a[2]*r[0] - a[0]*r[2];
+    e1[2] = a[0]*r[1] - a[1]*r[0];
+    const GLfloat m1 = sqrt(e1[0]*e1[0] + e1[1]*e1[1] + e1[2]*e1[2]);
+    e1[0] /= m1;
+    e1[1] /= m1;
+    e1[2] /= m1;
+    e2[0] = r[1]*e1[2] - r[2]*e1[1];
+    e2[1] = r[2]*e1[0] - r[0]*e1[2];
+    e2[2] = r[0]*e1[1] - r[1]*e1[0];
+
+    GLfloat *v = &V[(size_t) n * nv * __CYLINDER_STRIDE];
+    for (int k=0; k<nv; ++k) {
+      const GLfloat *u = &ring[3*k];
+      for (int d=0; d<3; ++d) {
+        const GLfloat nd = u[0]*e1[d] + u[1]*e2[d];
+        v[__CYLINDER_STRIDE*k + d] = x0[d] + radius*nd + u[2]*mag*r[d];
+        v[__CYLINDER_STRIDE*k + 3 + d] = nd;
+      }
+    }
 
-  glPopMatrix();
+    GLuint *i = &I[(size_t) n * ni];
+    const GLuint base = n * nv;
+    for (int s=0; s<slices; ++s) {
+      const GLuint b0 = base + 2*s, t0 = b0 + 1, b1 = b0 + 2, t1 = b0 + 3;
+      i[6*s + 0] = b0; i[6*s + 1] = b1; i[6*s + 2] = t0;
+      i[6*s + 3] = t0; i[6*s + 4] = b1; i[6*s + 5] = t1;
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, V.size()*sizeof(GLfloat),
+               V.empty() ? NULL : &V[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, I.size()*sizeof(GLuint),
+               I.empty() ? NULL : &I[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  num_indices = I.size();
+}
+void CylinderBatch::draw()
+{
+  if (num_indices == 0) return;
+  const GLsizei stride = __CYLINDER_STRIDE*sizeof(GLfloat);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexPointer(3, GL_FLOAT, stride, 0);
+  glNormalPointer(GL_FLOAT, stride, (GLvoid*) (3*sizeof(GLfloat)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 
-BoundingBox::BoundingBox()
+BoundingBox::BoundingBox() : edges(72), edges_width(-1)
 {
   gl_modes.push_back(GL_DEPTH_TEST);
   gl_modes.push_back(GL_LIGHTING);
@@ -43,47 +198,21 @@ BoundingBox::BoundingBox()
 
 void BoundingBox::draw_local()
 {
-  GLfloat x0[3], x1[3];
-  GLfloat lw = LineWidth * 0.01;
-
-  x0[0] = -0.5; x0[1] = -0.5; x0[2] = -0.5;
-  x1[0] = +0.5; x1[1] = -0.5; x1[2] = -0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = -0.5; x0[1] = -0.5; x0[2] = +0.5;
-  x1[0] = +0.5; x1[1] = -0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = -0.5; x0[1] = +0.5; x0[2] = -0.5;
-  x1[0] = +0.5; x1[1] = +0.5; x1[2] = -0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = -0.5; x0[1] = +0.5; x0[2] = +0.5;
-  x1[0] = +0.5; x1[1] = +0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-
-  x0[0] = -0.5; x0[1] = -0.5; x0[2] = -0.5;
-  x1[0] = -0.5; x1[1] = +0.5; x1[2] = -0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = +0.5; x0[1] = -0.5; x0[2] = -0.5;
-  x1[0] = +0.5; x1[1] = +0.5; x1[2] = -0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = -0.5; x0[1] = -0.5; x0[2] = +0.5;
-  x1[0] = -0.5; x1[1] = +0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = +0.5; x0[1] = -0.5; x0[2] = +0.5;
-  x1[0] = +0.5; x1[1] = +0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-
-  x0[0] = -0.5; x0[1] = -0.5; x0[2] = -0.5;
-  x1[0] = -0.5; x1[1] = -0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = -0.5; x0[1] = +0.5; x0[2] = -0.5;
-  x1[0] = -0.5; x1[1] = +0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = +0.5; x0[1] = -0.5; x0[2] = -0.5;
-  x1[0] = +0.5; x1[1] = -0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
-  x0[0] = +0.5; x0[1] = +0.5; x0[2] = -0.5;
-  x1[0] = +0.5; x1[1] = +0.5; x1[2] = +0.5;
-  draw_cylinder<GLfloat>(x0, x1, lw, lw);
+  static const GLfloat corners[8][3] =
+    {{-0.5, -0.5, -0.5}, {+0.5, -0.5, -0.5},
+     {-0.5, +0.5, -0.5}, {+0.5, +0.5, -0.5},
+     {-0.5, -0.5, +0.5}, {+0.5, -0.5, +0.5},
+     {-0.5, +0.5, +0.5}, {+0.5, +0.5, +0.5}};
+  static const GLuint segments[12][2] =
+    {{0, 1}, {4, 5}, {2, 3}, {6, 7},  // along x
+     {0, 2}, {1, 3}, {4, 6}, {5, 7},  // along y
+     {0, 4}, {2, 6}, {1, 5}, {3, 7}}; // along z
+
+  if (edges_width != LineWidth) {
+    edges_width = LineWidth;
+    edges.build(corners[0], segments[0], 12, LineWidth * 0.01);
+  }
+  edges.draw();
 }
 
 
@@ -139,9 +268,14 @@ void ImagePlane::draw_local()
   glTexCoord2f(1, 1); glVertex3f(Lx1, Ly1, 0);
   glTexCoord2f(1, 0); glVertex3f(Lx1, Ly0, 0);
   glEnd();
+
+  glActiveTexture(GL_TEXTURE0 + 2);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0 + 0);
 }
 
 ParametricSurface::ParametricSurface()
+  : built_source(NULL), built_version(-1), built_Nx(0), built_Ny(0)
 {
   gl_modes.push_back(GL_DEPTH_TEST);
   gl_modes.push_back(GL_LIGHTING);
@@ -150,6 +284,80 @@ ParametricSurface::ParametricSurface()
   gl_modes.push_back(GL_COLOR_MATERIAL);
   gl_modes.push_back(GL_AUTO_NORMAL);
   gl_modes.push_back(GL_NORMALIZE);
+  glGenBuffers(1, &vbo);
+  glGenBuffers(1, &ibo);
+}
+ParametricSurface::~ParametricSurface()
+{
+  glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &ibo);
+}
+void ParametricSurface::build_vertices(const GLfloat *data, int Nx, int Ny)
+// -----------------------------------------------------------------------------
+// Interleaves the points with smooth normals, taken as the cross product of
+// the centered differences along the two grid directions (one-sided on the
+// edges of the grid).
+// -----------------------------------------------------------------------------
+{
+  std::vector<GLfloat> V(6*Nx*Ny);
+
+#pragma omp parallel for schedule(static)
+  for (int i=0; i<Nx; ++i) {
+    const int i0 = i > 0 ? i-1 : i, i1 = i < Nx-1 ? i+1 : i;
+    for (int j=0; j<Ny; ++j) {
+      const int j0 = j > 0 ? j-1 : j, j1 = j < Ny-1 ? j+1 : j;
+      const GLfloat *a0 = &data[(i0*Ny + j)*3], *a1 = &data[(i1*Ny + j)*3];
+      const GLfloat *b0 = &data[(i*Ny + j0)*3], *b1 = &data[(i*Ny + j1)*3];
+      const GLfloat du[3] = {a1[0]-a0[0], a1[1]-a0[1], a1[2]-a0[2]};
+      const GLfloat dv[3] = {b1[0]-b0[0], b1[1]-b0[1], b1[2]-b0[2]};
+
+      GLfloat nrm[3];
+      nrm[0] = du[1]*dv[2] - du[2]*dv[1];
+      nrm[1] = du[2]*dv[0] - du[0]*dv[2];
+      nrm[2] = du[0]*dv[1] - du[1]*dv[0];
+      const GLfloat mag = sqrt(nrm[0]*nrm[0] + nrm[1]*nrm[1] + nrm[2]*nrm[2]);
+      if (mag > 0) {
+        nrm[0] /= mag;
+        nrm[1] /= mag;
+        nrm[2] /= mag;
+      }
+
+      GLfloat *v = &V[6*(i*Ny + j)];
+      v[0] = data[(i*Ny + j)*3 + 0];
+      v[1] = data[(i*Ny + j)*3 + 1];
+      v[2] = data[(i*Ny + j)*3 + 2];
+      v[3] = nrm[0];
+      v[4] = nrm[1];
+      v[5] = nrm[2];
+    }
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, V.size()*sizeof(GLfloat), &V[0],
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+void ParametricSurface::build_indices(int Nx, int Ny)
+{
+  std::vector<GLuint> I(6*(Nx-1)*(Ny-1));
+
+#pragma omp parallel for schedule(static)
+  for (int i=0; i<Nx-1; ++i) {
+    for (int j=0; j<Ny-1; ++j) {
+      const GLuint u = (i+0)*Ny + j+0;
+      const GLuint v = (i+0)*Ny + j+1;
+      const GLuint w = (i+1)*Ny + j+0;
+      const GLuint q = (i+1)*Ny + j+1;
+      GLuint *t = &I[6*(i*(Ny-1) + j)];
+      t[0] = u; t[1] = v; t[2] = w;
+      t[3] = v; t[4] = w; t[5] = q;
+    }
+  }
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, I.size()*sizeof(GLuint),
+               I.empty() ? NULL : &I[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 void ParametricSurface::draw_local()
 {
@@ -166,46 +374,72 @@ void ParametricSurface::draw_local()
   }
   int Nx = cp->second->get_num_points(0);
   int Ny = cp->second->get_num_points(1);
-  const GLfloat *data = cp->second->get_data();
 
-  glBegin(GL_TRIANGLES);
-  for (int i=0; i<Nx-1; ++i) {
-    for (int j=0; j<Ny-1; ++j) {
-      const GLfloat *u = &data[((i+0)*Ny + j+0)*3];
-      const GLfloat *v = &data[((i+0)*Ny + j+1)*3];
-      const GLfloat *w = &data[((i+1)*Ny + j+0)*3];
-      const GLfloat *q = &data[((i+1)*Ny + j+1)*3];
-
-      const GLfloat d1[3] = {v[0]-u[0], v[1]-u[1], v[2]-u[2]};
-      const GLfloat d2[3] = {w[0]-v[0], w[1]-v[1], w[2]-v[2]};
-      const GLfloat d3[3] = {q[0]-w[0], q[1]-w[1], q[2]-w[2]};
-
-      GLfloat n1[3];
-      n1[0] = d1[2]*d2[1] - d1[1]*d2[2];
-      n1[1] = d1[0]*d2[2] - d1[2]*d2[0];
-      n1[2] = d1[1]*d2[0] - d1[0]*d2[1];
-
-      GLfloat n2[3];
-      n2[0] = d3[2]*d2[1] - d3[1]*d2[2];
-      n2[1] = d3[0]*d2[2] - d3[2]*d2[0];
-      n2[2] = d3[1]*d2[0] - d3[0]*d2[1];
-
-      glNormal3fv(n1);
-      glVertex3fv(u);
-      glVertex3fv(v);
-      glVertex3fv(w);
-
-      glNormal3fv(n2);
-      glVertex3fv(v);
-      glVertex3fv(w);
-      glVertex3fv(q);
-    }
+  if (Nx < 2 || Ny < 2) {
+    return;
   }
-  glEnd();
+  if (built_source != cp->second ||
+      built_version != cp->second->get_version()) {
+    build_vertices(cp->second->get_data(), Nx, Ny);
+    built_source = cp->second;
+    built_version = cp->second->get_version();
+  }
+  if (built_Nx != Nx || built_Ny != Ny) {
+    build_indices(Nx, Ny);
+    built_Nx = Nx;
+    built_Ny = Ny;
+  }
+
+  const GLsizei stride = 6*sizeof(GLfloat);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexPointer(3, GL_FLOAT, stride, 0);
+  glNormalPointer(GL_FLOAT, stride, (GLvoid*) (3*sizeof(GLfloat)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+  glDrawElements(GL_TRIANGLES, 6*(Nx-1)*(Ny-1), GL_UNSIGNED_INT, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 
+static const char *SegmentModes[] = { "lines", "cylinders", "thick", NULL };
+enum { SEGMENTS_LINES, SEGMENTS_CYLINDERS, SEGMENTS_THICK };
+
+// -----------------------------------------------------------------------------
+// Expands each segment into a quad facing the screen, LineWidth pixels wide.
+// Every corner carries both end points of its segment: gl_Vertex is the first
+// and gl_MultiTexCoord0 the second, while gl_MultiTexCoord1 holds the end the
+// corner belongs to (0 or 1) and the side of the segment it is on (-1 or +1).
+// -----------------------------------------------------------------------------
+static const char *RibbonVert =
+  "uniform vec2 viewport;\n"
+  "uniform float width;\n"
+  "void main()\n"
+  "{\n"
+  "  vec4 a = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+  "  vec4 b = gl_ModelViewProjectionMatrix * vec4(gl_MultiTexCoord0.xyz, 1.0);\n"
+  "  vec2 d = b.xy / b.w * viewport - a.xy / a.w * viewport;\n"
+  "  d = length(d) > 1e-6 ? normalize(d) : vec2(1.0, 0.0);\n"
+  "  vec4 p = mix(a, b, gl_MultiTexCoord1.x);\n"
+  "  p.xy += vec2(-d.y, d.x) * gl_MultiTexCoord1.y * width / viewport * p.w;\n"
+  "  gl_Position = p;\n"
+  "  gl_FrontColor = gl_Color;\n"
+  "}\n";
+static const char *RibbonFrag =
+  "void main()\n"
+  "{\n"
+  "  gl_FragColor = gl_Color;\n"
+  "}\n";
+
 SegmentsEnsemble::SegmentsEnsemble()
+  : mode(SEGMENTS_LINES), tubes(16), tubes_source(NULL), tubes_version(-1),
+    tubes_width(-1), ribbon_source(NULL), ribbon_version(-1),
+    ribbon_shader(NULL)
 {
   gl_modes.push_back(GL_DEPTH_TEST);
   gl_modes.push_back(GL_LIGHTING);
@@ -214,6 +448,67 @@ SegmentsEnsemble::SegmentsEnsemble()
   gl_modes.push_back(GL_COLOR_MATERIAL);
   gl_modes.push_back(GL_AUTO_NORMAL);
   gl_modes.push_back(GL_NORMALIZE);
+  glGenBuffers(1, &ribbon_vbo);
+  glGenBuffers(1, &ribbon_ibo);
+}
+SegmentsEnsemble::~SegmentsEnsemble()
+{
+  glDeleteBuffers(1, &ribbon_vbo);
+  glDeleteBuffers(1, &ribbon_ibo);
+}
+void SegmentsEnsemble::build_ribbons(const GLfloat *verts,
+                                     const GLuint *indices, int nseg)
+{
+  std::vector<GLfloat> V((size_t) nseg * 4 * 8);
+  std::vector<GLuint> I((size_t) nseg * 6);
+
+#pragma omp parallel for schedule(static)
+  for (int n=0; n<nseg; ++n) {
+    const GLfloat *x0 = &verts[3*indices[2*n + 0]];
+    const GLfloat *x1 = &verts[3*indices[2*n + 1]];
+    GLfloat *v = &V[(size_t) n * 4 * 8];
+    for (int k=0; k<4; ++k) {
+      v[8*k + 0] = x0[0];
+      v[8*k + 1] = x0[1];
+      v[8*k + 2] = x0[2];
+      v[8*k + 3] = x1[0];
+      v[8*k + 4] = x1[1];
+      v[8*k + 5] = x1[2];
+      v[8*k + 6] = k / 2;            // end: 0, 0, 1, 1
+      v[8*k + 7] = k % 2 ? +1 : -1;  // side: -1, +1, -1, +1
+    }
+    GLuint *i = &I[(size_t) n * 6];
+    const GLuint base = 4*n;
+    i[0] = base + 0; i[1] = base + 2; i[2] = base + 1;
+    i[3] = base + 1; i[4] = base + 2; i[5] = base + 3;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, ribbon_vbo);
+  glBufferData(GL_ARRAY_BUFFER, V.size()*sizeof(GLfloat),
+               V.empty() ? NULL : &V[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ribbon_ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, I.size()*sizeof(GLuint),
+               I.empty() ? NULL : &I[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+bool SegmentsEnsemble::get_bounds(double *lo, double *hi)
+// -----------------------------------------------------------------------------
+// Cylinders reach their radius beyond the segments' end points.
+// -----------------------------------------------------------------------------
+{
+  if (!DrawableObject::get_bounds(lo, hi)) return false;
+  if (mode == SEGMENTS_CYLINDERS) {
+    for (int d=0; d<3; ++d) {
+      lo[d] -= 0.01*LineWidth;
+      hi[d] += 0.01*LineWidth;
+    }
+  }
+  return true;
+}
+double SegmentsEnsemble::get_pixel_margin()
+{
+  return mode == SEGMENTS_CYLINDERS ? 0.0 : 0.5*LineWidth;
 }
 void SegmentsEnsemble::draw_local()
 {
@@ -233,30 +528,242 @@ void SegmentsEnsemble::draw_local()
   const GLuint *indices = seg->second->get_indices();
   const int Np = seg->second->get_num_indices() / 2;
 
-  int cyl = 0;
-  if (cyl) {
-    for (int n=0; n<Np; ++n) {
-      const GLfloat *u = &verts[3*indices[2*n + 0]];
-      const GLfloat *v = &verts[3*indices[2*n + 1]];
-      draw_cylinder<GLfloat>(u, v, 0.01*LineWidth, 0.01*LineWidth);
+  if (mode == SEGMENTS_CYLINDERS) {
+    if (tubes_source != seg->second ||
+        tubes_version != seg->second->get_version() ||
+        tubes_width != LineWidth) {
+      tubes_source = seg->second;
+      tubes_version = seg->second->get_version();
+      tubes_width = LineWidth;
+      tubes.build(verts, indices, Np, 0.01*LineWidth);
     }
+    tubes.draw();
+  }
+  else if (mode == SEGMENTS_THICK) {
+    if (ribbon_shader == NULL) {
+      hold(ribbon_shader = create<ShaderProgram>(__lua_state));
+      ribbon_shader->set_program(RibbonVert, RibbonFrag);
+    }
+    if (ribbon_source != seg->second ||
+        ribbon_version != seg->second->get_version()) {
+      ribbon_source = seg->second;
+      ribbon_version = seg->second->get_version();
+      build_ribbons(verts, indices, Np);
+    }
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    const GLfloat viewport[2] = { (GLfloat) vp[2], (GLfloat) vp[3] };
+    const GLfloat width = LineWidth;
+    const GLsizei stride = 8*sizeof(GLfloat);
+
+    ribbon_shader->set_uniform_vec("viewport", viewport, 2);
+    ribbon_shader->set_uniform_vec("width", &width, 1);
+    ribbon_shader->activate();
+    GLStateCache::disable(GL_LIGHTING);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glClientActiveTexture(GL_TEXTURE0);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glClientActiveTexture(GL_TEXTURE1);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, ribbon_vbo);
+    glVertexPointer(3, GL_FLOAT, stride, 0);
+    glTexCoordPointer(2, GL_FLOAT, stride, (GLvoid*) (6*sizeof(GLfloat)));
+    glClientActiveTexture(GL_TEXTURE0);
+    glTexCoordPointer(3, GL_FLOAT, stride, (GLvoid*) (3*sizeof(GLfloat)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ribbon_ibo);
+    glDrawElements(GL_TRIANGLES, 6*Np, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glClientActiveTexture(GL_TEXTURE1);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glClientActiveTexture(GL_TEXTURE0);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    ribbon_shader->deactivate();
   }
   else {
-    glBegin(GL_LINES);
-    for (int n=0; n<Np; ++n) {
-      const GLfloat *u = &verts[3*indices[2*n + 0]];
-      const GLfloat *v = &verts[3*indices[2*n + 1]];
-      const GLfloat n[3] = {v[0]-u[0], v[1]-u[1], v[2]-u[2]};
-      glNormal3fv(n);
-      glVertex3fv(u);
-      glVertex3fv(v);
+    // Lines have no meaningful normal, so they are drawn unlit straight from
+    // the buffers the DataSource has already uploaded.
+    GLStateCache::disable(GL_LIGHTING);
+    const VertexStream vert = { GL_VERTEX_ARRAY, seg->second->get_vbo(), 3,
+                                3*sizeof(GLfloat), 0 };
+    glEnableClientState(GL_VERTEX_ARRAY);
+    draw_indexed(GL_LINES, seg->second, &vert, 1);
+    glDisableClientState(GL_VERTEX_ARRAY);
+  }
+}
+SegmentsEnsemble::LuaInstanceMethod
+SegmentsEnsemble::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_mode"] = _get_mode_;
+  attr["set_mode"] = _set_mode_;
+  RETURN_ATTR_OR_CALL_SUPER(DrawableObject);
+}
+int SegmentsEnsemble::_get_mode_(lua_State *L)
+{
+  SegmentsEnsemble *self = checkarg<SegmentsEnsemble>(L, 1);
+  lua_pushstring(L, SegmentModes[self->mode]);
+  return 1;
+}
+int SegmentsEnsemble::_set_mode_(lua_State *L)
+{
+  SegmentsEnsemble *self = checkarg<SegmentsEnsemble>(L, 1);
+  self->mode = luaL_checkoption(L, 2, NULL, SegmentModes);
+  ++self->Revision;
+  return 0;
+}
+
+
+// -----------------------------------------------------------------------------
+// Shades each point sprite as a sphere lit by GL_LIGHT0. The sprite is
+// LineWidth pixels across, scaled by the "sizes" DataSource if there is one,
+// which is bound to gl_MultiTexCoord0.
+// -----------------------------------------------------------------------------
+static const char *SpriteVert =
+  "#version 120\n"
+  "uniform float width;\n"
+  "void main()\n"
+  "{\n"
+  "  gl_Position = ftransform();\n"
+  "  gl_PointSize = width * gl_MultiTexCoord0.x;\n"
+  "  gl_FrontColor = gl_Color;\n"
+  "}\n";
+static const char *SpriteFrag =
+  "#version 120\n"
+  "void main()\n"
+  "{\n"
+  "  vec2 p = 2.0 * gl_PointCoord - 1.0;\n"
+  "  float r2 = dot(p, p);\n"
+  "  if (r2 > 1.0) discard;\n"
+  "  vec3 n = vec3(p.x, -p.y, sqrt(1.0 - r2));\n"
+  "  vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+  "  float d = max(dot(n, l), 0.0);\n"
+  "  float s = pow(max(dot(reflect(-l, n), vec3(0.0, 0.0, 1.0)), 0.0), 32.0);\n"
+  "  gl_FragColor = vec4(gl_Color.rgb * (0.3 + 0.7*d) + 0.4*s, gl_Color.a);\n"
+  "}\n";
+
+PointsEnsemble::PointsEnsemble()
+  : sprite_shader(NULL), sizes_source(NULL), sizes_version(-1), sizes_max(1.0)
+{
+  gl_modes.push_back(GL_DEPTH_TEST);
+  gl_modes.push_back(GL_BLEND);
+  gl_modes.push_back(GL_POINT_SPRITE);
+}
+double PointsEnsemble::get_pixel_margin()
+// -----------------------------------------------------------------------------
+// The sprites are LineWidth pixels across, times the largest of the sizes.
+// -----------------------------------------------------------------------------
+{
+  EntryDS siz = DataSources.find("sizes");
+  if (siz == DataSources.end()) {
+    sizes_source = NULL;
+    return 0.5*LineWidth;
+  }
+  siz->second->compile();
+  if (sizes_source != siz->second ||
+      sizes_version != siz->second->get_version()) {
+    const GLfloat *s = siz->second->get_data();
+    const int Ns = s ? siz->second->get_size() : 0;
+    sizes_source = siz->second;
+    sizes_version = siz->second->get_version();
+    sizes_max = 0.0;
+    for (int n=0; n<Ns; ++n) sizes_max = std::max(sizes_max, (double) s[n]);
+  }
+  return 0.5*LineWidth*sizes_max;
+}
+void PointsEnsemble::draw_local()
+// -----------------------------------------------------------------------------
+// Draws the "points" DataSource straight from its VBO with one glDrawArrays.
+// The optional "colors" (N,3) or (N,4) and "sizes" (N) sources are bound as
+// further vertex arrays. If the user has given a shader it is used instead of
+// the sphere impostor, with the points drawn LineWidth pixels across by
+// glPointSize, since GL_VERTEX_PROGRAM_POINT_SIZE is only enabled for the
+// impostor's own shader.
+// -----------------------------------------------------------------------------
+{
+  EntryDS pnt = DataSources.find("points");
+  EntryDS col = DataSources.find("colors");
+  EntryDS siz = DataSources.find("sizes");
+
+  if (pnt != DataSources.end()) {
+    pnt->second->compile();
+    pnt->second->check_has_data("points");
+    pnt->second->check_num_dimensions("points", 2);
+    pnt->second->check_num_points("points", 3, 1);
+  }
+  else {
+    return;
+  }
+  const int Np = pnt->second->get_num_points(0);
+
+  if (col != DataSources.end()) {
+    col->second->compile();
+    col->second->check_has_data("colors");
+    col->second->check_num_dimensions("colors", 2);
+    col->second->check_num_points("colors", Np, 0);
+    const int nc = col->second->get_num_points(1);
+    if (nc != 3 && nc != 4) {
+      luaL_error(__lua_state, "colors must have 3 or 4 components");
     }
-    glEnd();
   }
+  if (siz != DataSources.end()) {
+    siz->second->compile();
+    siz->second->check_has_data("sizes");
+    siz->second->check_num_points("sizes", Np, 0);
+    if (siz->second->get_size() != Np) {
+      luaL_error(__lua_state, "sizes must have one component");
+    }
+  }
+
+  if (shader == NULL) {
+    if (sprite_shader == NULL) {
+      hold(sprite_shader = create<ShaderProgram>(__lua_state));
+      sprite_shader->set_program(SpriteVert, SpriteFrag);
+    }
+    const GLfloat width = LineWidth;
+    sprite_shader->set_uniform_vec("width", &width, 1);
+    sprite_shader->activate();
+    GLStateCache::enable(GL_VERTEX_PROGRAM_POINT_SIZE); // the sprite sizes
+  }
+  glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
+  glPointSize(LineWidth);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glBindBuffer(GL_ARRAY_BUFFER, pnt->second->get_vbo());
+  glVertexPointer(3, GL_FLOAT, 3*sizeof(GLfloat), 0);
+
+  if (col != DataSources.end()) {
+    const int nc = col->second->get_num_points(1);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, col->second->get_vbo());
+    glColorPointer(nc, GL_FLOAT, nc*sizeof(GLfloat), 0);
+  }
+  if (siz != DataSources.end()) {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, siz->second->get_vbo());
+    glTexCoordPointer(1, GL_FLOAT, sizeof(GLfloat), 0);
+  }
+  else {
+    glTexCoord1f(1.0);
+  }
+
+  glDrawArrays(GL_POINTS, 0, Np);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (siz != DataSources.end()) glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  if (col != DataSources.end()) glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_FALSE);
+  glPointSize(1.0);
+  if (shader == NULL) sprite_shader->deactivate();
 }
 
 
 TrianglesEnsemble::TrianglesEnsemble()
+  : normals_source(NULL), normals_version(-1)
 {
   //  gl_modes.push_back(GL_CULL_FACE);
   gl_modes.push_back(GL_DEPTH_TEST);
@@ -265,10 +772,75 @@ TrianglesEnsemble::TrianglesEnsemble()
   gl_modes.push_back(GL_BLEND);
   gl_modes.push_back(GL_COLOR_MATERIAL);
   gl_modes.push_back(GL_NORMALIZE);
+  glGenBuffers(1, &normals_vbo);
+}
+TrianglesEnsemble::~TrianglesEnsemble()
+{
+  glDeleteBuffers(1, &normals_vbo);
+}
+void TrianglesEnsemble::build_normals(const GLfloat *verts, int Nv,
+                                      const GLuint *indices, int Nt)
+// -----------------------------------------------------------------------------
+// Computes area weighted vertex normals for the Nt triangles. Face normals are
+// found in parallel over triangles, and then gathered in parallel over
+// vertices through a vertex to face adjacency list, so that no two threads
+// write to the same normal.
+// -----------------------------------------------------------------------------
+{
+  for (int k=0; k<3*Nt; ++k) {
+    if (indices[k] >= (GLuint) Nv) {
+      luaL_error(__lua_state, "triangles index %d out of range [0, %d)",
+                 (int) indices[k], Nv);
+    }
+  }
+
+  std::vector<GLfloat> F(3*Nt); // face normals, with length twice the area
+  std::vector<GLfloat> N(3*Nv);
+  std::vector<int> start(Nv + 1, 0);
+  std::vector<int> faces(3*Nt);
+
+#pragma omp parallel for schedule(static)
+  for (int n=0; n<Nt; ++n) {
+    const GLfloat *u = &verts[3*indices[3*n + 0]];
+    const GLfloat *v = &verts[3*indices[3*n + 1]];
+    const GLfloat *w = &verts[3*indices[3*n + 2]];
+    const GLfloat d1[3] = {v[0]-u[0], v[1]-u[1], v[2]-u[2]};
+    const GLfloat d2[3] = {w[0]-v[0], w[1]-v[1], w[2]-v[2]};
+    GLfloat *f = &F[3*n];
+    f[0] = d1[2]*d2[1] - d1[1]*d2[2];
+    f[1] = d1[0]*d2[2] - d1[2]*d2[0];
+    f[2] = d1[1]*d2[0] - d1[0]*d2[1];
+  }
+
+  for (int k=0; k<3*Nt; ++k) ++start[indices[k] + 1];
+  for (int i=0; i<Nv; ++i) start[i + 1] += start[i];
+  std::vector<int> fill(start.begin(), start.end() - 1);
+  for (int k=0; k<3*Nt; ++k) faces[fill[indices[k]]++] = k / 3;
+
+#pragma omp parallel for schedule(static)
+  for (int i=0; i<Nv; ++i) {
+    GLfloat m[3] = {0, 0, 0};
+    for (int k=start[i]; k<start[i + 1]; ++k) {
+      const GLfloat *f = &F[3*faces[k]];
+      m[0] += f[0];
+      m[1] += f[1];
+      m[2] += f[2];
+    }
+    const GLfloat mag = sqrt(m[0]*m[0] + m[1]*m[1] + m[2]*m[2]);
+    N[3*i + 0] = mag > 0 ? m[0] / mag : 0;
+    N[3*i + 1] = mag > 0 ? m[1] / mag : 0;
+    N[3*i + 2] = mag > 0 ? m[2] / mag : 1;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, normals_vbo);
+  glBufferData(GL_ARRAY_BUFFER, N.size()*sizeof(GLfloat),
+               N.empty() ? NULL : &N[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void TrianglesEnsemble::draw_local()
 {
+  EntryDS msh = DataSources.find("mesh");
   EntryDS tri = DataSources.find("triangles");
   EntryDS nrm = DataSources.find("normals");
   EntryDS lut = DataSources.find("color_table");
@@ -277,7 +849,14 @@ void TrianglesEnsemble::draw_local()
   if (shader) {
     shader->set_uniform("tex1d", 0);
   }
-  if (tri != DataSources.end()) {
+  if (msh != DataSources.end()) {
+    msh->second->compile();
+    msh->second->check_has_data("mesh");
+    msh->second->check_has_indices("mesh");
+    msh->second->check_num_dimensions("mesh", 2);
+    msh->second->check_num_points("mesh", __MESH_STRIDE, 1);
+  }
+  else if (tri != DataSources.end()) {
     tri->second->compile();
     tri->second->check_has_data("triangles");
     tri->second->check_has_indices("triangles");
@@ -306,52 +885,59 @@ void TrianglesEnsemble::draw_local()
     lut->second->become_texture();
   }
 
-  const GLfloat *verts = tri->second->get_data();
-  const GLuint *indices = tri->second->get_indices();
-  const int Np = tri->second->get_num_indices(); // number of indices
-
-  if (nrm != DataSources.end() && sca != DataSources.end()) {
+  if (msh != DataSources.end()) {
+    // Position, normal and scalar are fetched from a single interleaved
+    // stream.
+    const GLsizei stride = __MESH_STRIDE*sizeof(GLfloat);
     glEnableClientState(GL_VERTEX_ARRAY);
     glEnableClientState(GL_NORMAL_ARRAY);
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 
-    // Note: glRangeDrawElements might be faster according to
-    // http://www.spec.org/gwpg/gpc.static/vbo_whitepaper.html
-    glBindBuffer(GL_ARRAY_BUFFER, tri->second->get_vbo());
-    glVertexPointer(3, GL_FLOAT, 3*sizeof(GLfloat), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, nrm->second->get_vbo());
-    glNormalPointer(GL_FLOAT, 3*sizeof(GLfloat), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, sca->second->get_vbo());
-    glTexCoordPointer(1, GL_FLOAT, sizeof(GLfloat), 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tri->second->get_ibo());
-    glDrawElements(GL_TRIANGLES, Np, GL_UNSIGNED_INT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    const GLuint vbo = msh->second->get_vbo();
+    const VertexStream streams[3] =
+      {{ GL_VERTEX_ARRAY, vbo, 3, stride, 0 },
+       { GL_NORMAL_ARRAY, vbo, 3, stride, 3*sizeof(GLfloat) },
+       { GL_TEXTURE_COORD_ARRAY, vbo, 1, stride, 6*sizeof(GLfloat) }};
+    draw_indexed(GL_TRIANGLES, msh->second, streams, 3);
 
     glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     glDisableClientState(GL_NORMAL_ARRAY);
     glDisableClientState(GL_VERTEX_ARRAY);
+    return;
   }
-  else {
-    glBegin(GL_TRIANGLES);
-    for (int n=0; n<Np/3; ++n) {
-      const GLfloat *u = &verts[3*indices[3*n + 0]];
-      const GLfloat *v = &verts[3*indices[3*n + 1]];
-      const GLfloat *w = &verts[3*indices[3*n + 2]];
-
-      const GLfloat n1[3] = {v[0]-u[0], v[1]-u[1], v[2]-u[2]};
-      const GLfloat n2[3] = {w[0]-v[0], w[1]-v[1], w[2]-v[2]};
-      
-      GLfloat n[3];
-      n[0] = n1[2]*n2[1] - n1[1]*n2[2];
-      n[1] = n1[0]*n2[2] - n1[2]*n2[0];
-      n[2] = n1[1]*n2[0] - n1[0]*n2[1];
-      
-      glNormal3fv(n);
-      glVertex3fv(v);
-      glVertex3fv(u);
-      glVertex3fv(w);
-    }
-    glEnd();
+
+  const int Np = tri->second->get_num_indices(); // number of indices
+
+  if (nrm == DataSources.end() &&
+      (normals_source != tri->second ||
+       normals_version != tri->second->get_version())) {
+    build_normals(tri->second->get_data(), tri->second->get_size() / 3,
+                  tri->second->get_indices(), Np / 3);
+    normals_source = tri->second;
+    normals_version = tri->second->get_version();
   }
-}
 
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+
+  // Note: glRangeDrawElements might be faster according to
+  // http://www.spec.org/gwpg/gpc.static/vbo_whitepaper.html
+  VertexStream streams[3] =
+    {{ GL_VERTEX_ARRAY, tri->second->get_vbo(), 3, 3*sizeof(GLfloat), 0 },
+     { GL_NORMAL_ARRAY, nrm != DataSources.end() ?
+       nrm->second->get_vbo() : normals_vbo, 3, 3*sizeof(GLfloat), 0 },
+     { GL_TEXTURE_COORD_ARRAY, 0, 1, sizeof(GLfloat), 0 }};
+  int nstreams = 2;
+  if (sca != DataSources.end()) {
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    streams[2].vbo = sca->second->get_vbo();
+    nstreams = 3;
+  }
+  draw_indexed(GL_TRIANGLES, tri->second, streams, nstreams);
+
+  if (sca != DataSources.end()) {
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  }
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
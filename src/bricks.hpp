@@ -0,0 +1,69 @@
+/* -----------------------------------------------------------------------------
+ *
+ * Value ranges over the bricks of 3d DataSource arrays, used to skip the parts
+ * of a volume which cannot contribute. An array has shape (N[0],N[1],N[2]), so
+ * that the last axis varies fastest, and is divided into bricks of B^3 voxels
+ * starting from voxel (0,0,0). The color tables tested against the ranges have
+ * 256 RGBA entries over values in [0,1].
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef __LuviewBricks_HEADER__
+#define __LuviewBricks_HEADER__
+
+#include <cmath>
+#include <algorithm>
+
+
+static inline void brick_ranges(const GLfloat *f, const int *N, int B,
+                                int below, const int *nb, GLfloat *lo,
+                                GLfloat *hi)
+// -----------------------------------------------------------------------------
+// Finds the least and greatest value of each of the nb[0]*nb[1]*nb[2] bricks.
+// A brick's range takes in `below` voxels before its lower faces and one
+// beyond its upper faces, clamped to the array.
+// -----------------------------------------------------------------------------
+{
+  const int Nb = nb[0]*nb[1]*nb[2];
+
+#pragma omp parallel for schedule(dynamic)
+  for (int n=0; n<Nb; ++n) {
+    const int b[3] = { n / (nb[1]*nb[2]), (n / nb[2]) % nb[1], n % nb[2] };
+    int i0[3], i1[3];
+    for (int d=0; d<3; ++d) {
+      i0[d] = std::max(b[d]*B - below, 0);
+      i1[d] = std::min((b[d] + 1)*B, N[d] - 1);
+    }
+    GLfloat l = f[(i0[0]*N[1] + i0[1])*N[2] + i0[2]], h = l;
+    for (int i=i0[0]; i<=i1[0]; ++i) {
+      for (int j=i0[1]; j<=i1[1]; ++j) {
+        const GLfloat *row = f + (i*N[1] + j)*N[2];
+        for (int k=i0[2]; k<=i1[2]; ++k) {
+          l = std::min(l, row[k]);
+          h = std::max(h, row[k]);
+        }
+      }
+    }
+    lo[n] = l;
+    hi[n] = h;
+  }
+}
+
+static inline bool table_is_transparent(const GLfloat *table, GLfloat lo,
+                                        GLfloat hi)
+// -----------------------------------------------------------------------------
+// Whether the color table has zero alpha over the values from lo to hi. The
+// entries either side of the range are taken in, since the linear filter
+// blends them into the values at its ends.
+// -----------------------------------------------------------------------------
+{
+  const int t0 = std::max((int) floor(lo*256 - 0.5), 0);
+  const int t1 = std::min((int) floor(hi*256 - 0.5) + 1, 255);
+  for (int t=t0; t<=t1; ++t) {
+    if (table[4*t + 3] > 0.0) return false;
+  }
+  return true;
+}
+
+#endif // __LuviewBricks_HEADER__
@@ -0,0 +1,710 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * MeshDecimationSource: a triangle mesh simplified to a target number of
+ * triangles by quadric error metric edge collapse.
+ *
+ * NOTES:
+ *
+ * The input is an (N,3) DataSource of positions, such as the "triangles"
+ * output of a Tesselation3D, or the (N,7) "mesh" of a ParametricVertexSource3D
+ * or IsosurfaceSource, along with the index buffer of its triangles. Vertices
+ * at exactly the same position are merged first, so that meshes built from
+ * separate pieces can be simplified across their seams.
+ *
+ * Each vertex carries the sum of the squared distances to the planes of its
+ * triangles, weighted by their areas, as a quadric. Collapsing an edge moves
+ * its two vertices to the point minimizing the sum of their quadrics, and the
+ * cheapest edges are collapsed first. Edges on an open border also carry the
+ * plane through them perpendicular to their triangle, heavily weighted, so
+ * that the border keeps its shape. A collapse is refused if it would flip a
+ * triangle or join the mesh into a non-manifold one.
+ *
+ * The bounding box is divided into a grid of partitions. A vertex is free to
+ * move if all its triangles lie within its partition, and the partitions are
+ * simplified in parallel, each by the same fraction, collapsing only edges
+ * between free vertices, so that no two threads touch the same triangle. This
+ * is done in a few rounds, the grid shifted each time so that the triangles
+ * held fixed along the partition boundaries are simplified by the next. The
+ * rounds stop a few times short of the target, and a final pass over the
+ * whole mesh makes the remaining collapses in order of cost.
+ *
+ * Normals are found again from the simplified triangles. If the input had
+ * normals, the new ones are made to point the same way, and the scalars are
+ * interpolated along each collapsed edge.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <queue>
+#include <algorithm>
+#include "luview.hpp"
+
+#define __DECIMATE_CELL_FACES 4096 // triangles per partition, roughly
+#define __DECIMATE_MAX_CELLS 16 // partitions along each axis, at most
+#define __DECIMATE_ROUNDS 3 // of parallel simplification, on shifted partitions
+#define __DECIMATE_BORDER_WEIGHT 1000.0 // of the planes through border edges
+
+struct Quadric
+{
+  // upper triangle of the symmetric 4x4 matrix, by rows
+  double q[10];
+} ;
+
+struct DecimationMesh
+{
+  std::vector<double> pos; // three per vertex
+  std::vector<double> scalars;
+  std::vector<Quadric> quadrics;
+  std::vector<GLuint> tri; // three per triangle
+  std::vector<char> dead; // of each triangle
+  std::vector<std::vector<int> > vfaces; // live triangles around each vertex
+  std::vector<int> stamp; // changed whenever a vertex is
+  std::vector<int> region; // partition of each free vertex, otherwise -1
+} ;
+
+struct Collapse
+{
+  double cost;
+  double length; // squared, to prefer short edges among equally cheap ones
+  int a, b; // b is collapsed into a
+  int sa, sb; // stamps of a and b when the cost was found
+  bool operator<(const Collapse &c) const
+  {
+    return cost != c.cost ? cost > c.cost : length > c.length;
+  }
+} ;
+
+struct WeldOrder
+{
+  const GLfloat *x;
+  int stride;
+  bool operator()(int m, int n) const
+  {
+    const GLfloat *u = x + stride*m, *v = x + stride*n;
+    if (u[0] != v[0]) return u[0] < v[0];
+    if (u[1] != v[1]) return u[1] < v[1];
+    if (u[2] != v[2]) return u[2] < v[2];
+    return m < n;
+  }
+} ;
+
+
+static void quadric_add_plane(Quadric &Q, const double *n, double d, double w)
+// -----------------------------------------------------------------------------
+// Adds w times the squared distance to the plane n.x + d = 0, where n is a
+// unit vector.
+// -----------------------------------------------------------------------------
+{
+  const double p[4] = { n[0], n[1], n[2], d };
+  int m = 0;
+  for (int i=0; i<4; ++i) {
+    for (int j=i; j<4; ++j) {
+      Q.q[m++] += w * p[i] * p[j];
+    }
+  }
+}
+
+static void quadric_add(Quadric &Q, const Quadric &R)
+{
+  for (int m=0; m<10; ++m) Q.q[m] += R.q[m];
+}
+
+static double quadric_error(const Quadric &Q, const double *x)
+{
+  const double *q = Q.q;
+  return (q[0]*x[0]*x[0] + 2*q[1]*x[0]*x[1] + 2*q[2]*x[0]*x[2] +
+          q[4]*x[1]*x[1] + 2*q[5]*x[1]*x[2] + q[7]*x[2]*x[2] +
+          2*q[3]*x[0] + 2*q[6]*x[1] + 2*q[8]*x[2] + q[9]);
+}
+
+static bool quadric_optimum(const Quadric &Q, double *x)
+// -----------------------------------------------------------------------------
+// Writes the point of least error into x, returning false if there is no
+// single one, as for a quadric made of parallel planes.
+// -----------------------------------------------------------------------------
+{
+  const double *q = Q.q;
+  const double a = q[0], b = q[1], c = q[2];
+  const double e = q[4], f = q[5], i = q[7];
+  const double A = e*i - f*f, B = c*f - b*i, C = b*f - c*e;
+  const double det = a*A + b*B + c*C;
+  const double scale = std::max(a, std::max(e, i));
+
+  if (fabs(det) <= 1e-9 * scale*scale*scale || scale <= 0.0) return false;
+
+  const double D = a*i - c*c, E = b*c - a*f, F = a*e - b*b;
+  const double r[3] = { -q[3], -q[6], -q[8] };
+  x[0] = (A*r[0] + B*r[1] + C*r[2]) / det;
+  x[1] = (B*r[0] + D*r[1] + E*r[2]) / det;
+  x[2] = (C*r[0] + E*r[1] + F*r[2]) / det;
+  return true;
+}
+
+static void face_normal(const double *u, const double *v, const double *w,
+                        double *n)
+// -----------------------------------------------------------------------------
+// Writes the normal of the triangle (u,v,w), whose length is twice its area.
+// -----------------------------------------------------------------------------
+{
+  const double d1[3] = { v[0] - u[0], v[1] - u[1], v[2] - u[2] };
+  const double d2[3] = { w[0] - u[0], w[1] - u[1], w[2] - u[2] };
+  n[0] = d1[1]*d2[2] - d1[2]*d2[1];
+  n[1] = d1[2]*d2[0] - d1[0]*d2[2];
+  n[2] = d1[0]*d2[1] - d1[1]*d2[0];
+}
+
+static double edge_cost(const DecimationMesh &M, int a, int b, double *x,
+                        double &t)
+// -----------------------------------------------------------------------------
+// Finds where the edge (a,b) would be collapsed to, returning the error there.
+// The parameter t of that point along the edge interpolates the scalars.
+// -----------------------------------------------------------------------------
+{
+  Quadric Q = M.quadrics[a];
+  quadric_add(Q, M.quadrics[b]);
+  const double *pa = &M.pos[3*a];
+  const double *pb = &M.pos[3*b];
+
+  if (!quadric_optimum(Q, x)) {
+    // Try the midpoint first, so that it is kept when the ends are no worse,
+    // as they are not on flat parts of the mesh.
+    const double along[3] = { 0.5, 0.0, 1.0 };
+    double best = -1.0;
+    for (int n=0; n<3; ++n) {
+      const double s = along[n];
+      const double y[3] = { pa[0] + s*(pb[0] - pa[0]),
+                            pa[1] + s*(pb[1] - pa[1]),
+                            pa[2] + s*(pb[2] - pa[2]) };
+      const double err = quadric_error(Q, y);
+      if (best < 0.0 || err < best) {
+        best = err;
+        x[0] = y[0]; x[1] = y[1]; x[2] = y[2];
+      }
+    }
+  }
+  double ee = 0.0, ex = 0.0;
+  for (int d=0; d<3; ++d) {
+    ee += (pb[d] - pa[d]) * (pb[d] - pa[d]);
+    ex += (pb[d] - pa[d]) * (x[d] - pa[d]);
+  }
+  t = ee > 0.0 ? std::min(std::max(ex / ee, 0.0), 1.0) : 0.0;
+  return std::max(quadric_error(Q, x), 0.0);
+}
+
+static void neighbors(const DecimationMesh &M, int a, std::vector<int> &nbrs)
+// -----------------------------------------------------------------------------
+// Writes the vertices sharing a triangle with a, sorted and without repeats.
+// -----------------------------------------------------------------------------
+{
+  nbrs.clear();
+  const std::vector<int> &faces = M.vfaces[a];
+  for (unsigned int m=0; m<faces.size(); ++m) {
+    for (int k=0; k<3; ++k) {
+      const int w = M.tri[3*faces[m] + k];
+      if (w != a) nbrs.push_back(w);
+    }
+  }
+  std::sort(nbrs.begin(), nbrs.end());
+  nbrs.erase(std::unique(nbrs.begin(), nbrs.end()), nbrs.end());
+}
+
+static bool collapse_is_valid(const DecimationMesh &M, int a, int b,
+                              const double *x, std::vector<int> &na,
+                              std::vector<int> &nb)
+{
+  // The link condition: the vertices adjacent to both a and b must be just
+  // those of the triangles on the edge.
+  int shared = 0;
+  const std::vector<int> &fa = M.vfaces[a];
+  for (unsigned int m=0; m<fa.size(); ++m) {
+    const GLuint *v = &M.tri[3*fa[m]];
+    shared += (v[0] == (GLuint)b || v[1] == (GLuint)b || v[2] == (GLuint)b);
+  }
+  neighbors(M, a, na);
+  neighbors(M, b, nb);
+  int common = 0;
+  for (unsigned int i=0, j=0; i<na.size() && j<nb.size();) {
+    if      (na[i] < nb[j]) ++i;
+    else if (nb[j] < na[i]) ++j;
+    else { ++common; ++i; ++j; }
+  }
+  if (shared == 0 || common != shared) return false;
+
+  // No remaining triangle may flip over or become degenerate.
+  const int ends[2] = { a, b };
+  for (int e=0; e<2; ++e) {
+    const std::vector<int> &faces = M.vfaces[ends[e]];
+    for (unsigned int m=0; m<faces.size(); ++m) {
+      const GLuint *v = &M.tri[3*faces[m]];
+      const double *p[3];
+      const double *q[3];
+      int on_edge = 0;
+      for (int k=0; k<3; ++k) {
+        p[k] = q[k] = &M.pos[3*v[k]];
+        if (v[k] == (GLuint)a || v[k] == (GLuint)b) {
+          q[k] = x;
+          ++on_edge;
+        }
+      }
+      if (on_edge == 2) continue; // removed by the collapse
+      double n0[3], n1[3];
+      face_normal(p[0], p[1], p[2], n0);
+      face_normal(q[0], q[1], q[2], n1);
+      if (n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2] <= 0.0) return false;
+    }
+  }
+  return true;
+}
+
+static int collapse(DecimationMesh &M, int a, int b, const double *x, double t)
+// -----------------------------------------------------------------------------
+// Collapses b into a at x, returning the number of triangles removed.
+// -----------------------------------------------------------------------------
+{
+  int removed = 0;
+  std::vector<int> &fa = M.vfaces[a];
+  const std::vector<int> &fb = M.vfaces[b];
+
+  for (unsigned int m=0; m<fb.size(); ++m) {
+    const int f = fb[m];
+    GLuint *v = &M.tri[3*f];
+    if (v[0] == (GLuint)a || v[1] == (GLuint)a || v[2] == (GLuint)a) {
+      M.dead[f] = 1;
+      ++removed;
+      for (int k=0; k<3; ++k) {
+        if (v[k] == (GLuint)a || v[k] == (GLuint)b) continue;
+        std::vector<int> &fw = M.vfaces[v[k]];
+        fw.erase(std::find(fw.begin(), fw.end(), f));
+      }
+    }
+    else {
+      for (int k=0; k<3; ++k) if (v[k] == (GLuint)b) v[k] = a;
+      fa.push_back(f);
+    }
+  }
+  unsigned int live = 0;
+  for (unsigned int m=0; m<fa.size(); ++m) {
+    if (!M.dead[fa[m]]) fa[live++] = fa[m];
+  }
+  fa.resize(live);
+  M.vfaces[b].clear();
+
+  for (int d=0; d<3; ++d) M.pos[3*a + d] = x[d];
+  M.scalars[a] += t * (M.scalars[b] - M.scalars[a]);
+  quadric_add(M.quadrics[a], M.quadrics[b]);
+  ++M.stamp[a];
+  ++M.stamp[b];
+  return removed;
+}
+
+static void push_edges(const DecimationMesh &M, int region, int a, int above,
+                       std::vector<int> &nbrs, std::priority_queue<Collapse> &heap)
+// -----------------------------------------------------------------------------
+// Queues the edges from a to its neighbors in the same region numbered higher
+// than `above`.
+// -----------------------------------------------------------------------------
+{
+  neighbors(M, a, nbrs);
+  for (unsigned int m=0; m<nbrs.size(); ++m) {
+    const int w = nbrs[m];
+    if (w <= above || M.region[w] != region) continue;
+    Collapse c;
+    double x[3], t;
+    c.cost = edge_cost(M, a, w, x, t);
+    c.length = 0.0;
+    for (int d=0; d<3; ++d) {
+      c.length += (M.pos[3*w + d] - M.pos[3*a + d]) *
+        (M.pos[3*w + d] - M.pos[3*a + d]);
+    }
+    c.a = a;
+    c.b = w;
+    c.sa = M.stamp[a];
+    c.sb = M.stamp[w];
+    heap.push(c);
+  }
+}
+
+static int decimate_region(DecimationMesh &M, int region,
+                           const std::vector<int> &verts, int faces, int target)
+// -----------------------------------------------------------------------------
+// Collapses edges between the given vertices of a region, cheapest first,
+// until its number of triangles reaches the target or no edge can be
+// collapsed. Returns the number of triangles removed.
+// -----------------------------------------------------------------------------
+{
+  std::priority_queue<Collapse> heap;
+  std::vector<int> na, nb;
+  int removed = 0;
+
+  for (unsigned int m=0; m<verts.size(); ++m) {
+    push_edges(M, region, verts[m], verts[m], na, heap);
+  }
+  while (faces - removed > target && !heap.empty()) {
+    const Collapse c = heap.top();
+    heap.pop();
+    if (M.stamp[c.a] != c.sa || M.stamp[c.b] != c.sb) continue; // stale
+    double x[3], t;
+    edge_cost(M, c.a, c.b, x, t);
+    if (!collapse_is_valid(M, c.a, c.b, x, na, nb)) continue;
+    removed += collapse(M, c.a, c.b, x, t);
+    push_edges(M, region, c.a, -1, na, heap);
+  }
+  return removed;
+}
+
+
+static int decimate_partitions(DecimationMesh &M, const double *lo,
+                               const double *hi, int P, double shift,
+                               double keep)
+// -----------------------------------------------------------------------------
+// Divides the box [lo,hi] into P partitions along each axis, shifted by the
+// given fraction of one, and simplifies them in parallel, each to the fraction
+// `keep` of the triangles within it. Returns the number of triangles removed.
+// -----------------------------------------------------------------------------
+{
+  const int Nv = M.vfaces.size();
+  const int Nf = M.dead.size();
+  const int Q = P + 1; // counting the partial one the shift opens at the end
+  const int Nc = Q*Q*Q;
+
+  std::vector<int> cell(Nv);
+  for (int v=0; v<Nv; ++v) {
+    int c = 0;
+    for (int d=0; d<3; ++d) {
+      const double s = hi[d] > lo[d] ? (M.pos[3*v + d] - lo[d]) /
+        (hi[d] - lo[d]) : 0.0;
+      c = c*Q + std::min((int) (s*P + shift), P);
+    }
+    cell[v] = c;
+  }
+  M.region = cell;
+
+  std::vector<int> cell_faces(Nc, 0);
+  for (int f=0; f<Nf; ++f) {
+    if (M.dead[f]) continue;
+    const GLuint *v = &M.tri[3*f];
+    if (cell[v[0]] == cell[v[1]] && cell[v[1]] == cell[v[2]]) {
+      ++cell_faces[cell[v[0]]];
+    }
+    else {
+      for (int k=0; k<3; ++k) M.region[v[k]] = -1;
+    }
+  }
+  std::vector<std::vector<int> > cell_verts(Nc);
+  for (int v=0; v<Nv; ++v) {
+    if (M.region[v] != -1 && !M.vfaces[v].empty()) {
+      cell_verts[M.region[v]].push_back(v);
+    }
+  }
+
+  int removed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:removed)
+  for (int c=0; c<Nc; ++c) {
+    removed += decimate_region(M, c, cell_verts[c], cell_faces[c],
+                               (int) (keep * cell_faces[c]));
+  }
+  return removed;
+}
+
+
+static int decimate_mesh(const GLfloat *input, int stride, int Nin,
+                         const GLuint *indices, int Nind, int target,
+                         std::vector<GLfloat> &verts,
+                         std::vector<GLuint> &out_indices)
+// -----------------------------------------------------------------------------
+// Simplifies the triangles of the input, whose rows have 3 or __MESH_STRIDE
+// columns, writing the interleaved mesh and its indices. Returns the number of
+// triangles left.
+// -----------------------------------------------------------------------------
+{
+  // ---------------------------------------------------------------------------
+  // Merge the vertices at equal positions, keeping the first of each.
+  // ---------------------------------------------------------------------------
+  std::vector<int> order(Nin), first;
+  std::vector<GLuint> weld(Nin);
+  for (int n=0; n<Nin; ++n) order[n] = n;
+  WeldOrder by_position;
+  by_position.x = input;
+  by_position.stride = stride;
+  std::sort(order.begin(), order.end(), by_position);
+
+  for (int m=0; m<Nin; ++m) {
+    const GLfloat *u = input + stride*order[m];
+    const GLfloat *v = input + stride*order[m == 0 ? 0 : m - 1];
+    if (m == 0 || u[0] != v[0] || u[1] != v[1] || u[2] != v[2]) {
+      first.push_back(order[m]);
+    }
+    weld[order[m]] = first.size() - 1;
+  }
+  const int Nv = first.size();
+
+  DecimationMesh M;
+  M.pos.resize(3*Nv);
+  M.scalars.resize(Nv);
+  for (int v=0; v<Nv; ++v) {
+    const GLfloat *u = input + stride*first[v];
+    for (int d=0; d<3; ++d) M.pos[3*v + d] = u[d];
+    M.scalars[v] = stride == __MESH_STRIDE ? u[6] : 0.0;
+  }
+  for (int n=0; n+2<Nind; n+=3) {
+    const GLuint v[3] = { weld[indices[n]], weld[indices[n+1]],
+                          weld[indices[n+2]] };
+    if (v[0] == v[1] || v[1] == v[2] || v[2] == v[0]) continue;
+    M.tri.insert(M.tri.end(), v, v + 3);
+  }
+  const int Nf = M.tri.size() / 3;
+  M.dead.assign(Nf, 0);
+  M.stamp.assign(Nv, 0);
+  M.vfaces.resize(Nv);
+  for (int f=0; f<Nf; ++f) {
+    for (int k=0; k<3; ++k) M.vfaces[M.tri[3*f + k]].push_back(f);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Sum the quadrics of the triangle planes, and of the border planes.
+  // ---------------------------------------------------------------------------
+  Quadric zero;
+  for (int m=0; m<10; ++m) zero.q[m] = 0.0;
+  M.quadrics.assign(Nv, zero);
+
+  std::vector<double> fnormal(3*Nf);
+  std::vector<std::pair<std::pair<int,int>, int> > edges(3*Nf);
+
+#pragma omp parallel for schedule(static)
+  for (int f=0; f<Nf; ++f) {
+    const GLuint *v = &M.tri[3*f];
+    face_normal(&M.pos[3*v[0]], &M.pos[3*v[1]], &M.pos[3*v[2]], &fnormal[3*f]);
+    for (int k=0; k<3; ++k) {
+      const int u = v[k], w = v[(k + 1) % 3];
+      edges[3*f + k] = std::make_pair(std::make_pair(std::min(u, w),
+                                                     std::max(u, w)), f);
+    }
+  }
+  for (int f=0; f<Nf; ++f) {
+    const GLuint *v = &M.tri[3*f];
+    double *n = &fnormal[3*f];
+    const double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if (len <= 0.0) continue;
+    const double u[3] = { n[0]/len, n[1]/len, n[2]/len };
+    const double *p = &M.pos[3*v[0]];
+    const double d = -(u[0]*p[0] + u[1]*p[1] + u[2]*p[2]);
+    for (int k=0; k<3; ++k) quadric_add_plane(M.quadrics[v[k]], u, d, 0.5*len);
+  }
+
+  std::sort(edges.begin(), edges.end());
+  for (unsigned int m=0; m<edges.size(); ++m) {
+    const bool border =
+      (m == 0 || edges[m - 1].first != edges[m].first) &&
+      (m + 1 == edges.size() || edges[m + 1].first != edges[m].first);
+    if (!border) continue;
+
+    const int u = edges[m].first.first, w = edges[m].first.second;
+    const double *n = &fnormal[3*edges[m].second];
+    const double *pu = &M.pos[3*u], *pw = &M.pos[3*w];
+    const double e[3] = { pw[0] - pu[0], pw[1] - pu[1], pw[2] - pu[2] };
+    double b[3] = { e[1]*n[2] - e[2]*n[1], e[2]*n[0] - e[0]*n[2],
+                    e[0]*n[1] - e[1]*n[0] };
+    const double len = sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+    if (len <= 0.0) continue;
+    for (int d=0; d<3; ++d) b[d] /= len;
+    const double d = -(b[0]*pu[0] + b[1]*pu[1] + b[2]*pu[2]);
+    const double w2 = __DECIMATE_BORDER_WEIGHT *
+      (e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+    quadric_add_plane(M.quadrics[u], b, d, w2);
+    quadric_add_plane(M.quadrics[w], b, d, w2);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Simplify the partitions in parallel, and then the whole mesh.
+  // ---------------------------------------------------------------------------
+  int faces = Nf;
+
+  if (faces > target) {
+    double lo[3], hi[3];
+    for (int d=0; d<3; ++d) lo[d] = hi[d] = Nv ? M.pos[d] : 0.0;
+    for (int v=0; v<Nv; ++v) {
+      for (int d=0; d<3; ++d) {
+        lo[d] = std::min(lo[d], M.pos[3*v + d]);
+        hi[d] = std::max(hi[d], M.pos[3*v + d]);
+      }
+    }
+    const double Pf = pow((double) Nf / __DECIMATE_CELL_FACES, 1.0/3.0);
+    const int P = std::min(std::max((int) (Pf + 0.5), 1), __DECIMATE_MAX_CELLS);
+
+    // Each round brings the number of triangles the same factor closer to
+    // the target, leaving the last few collapses to the whole mesh.
+    for (int r=0; r<__DECIMATE_ROUNDS && P > 1 && faces > target; ++r) {
+      const double goal = Nf * pow((double) target / Nf,
+                                   (r + 1.0) / (__DECIMATE_ROUNDS + 1));
+      faces -= decimate_partitions(M, lo, hi, P, (double) r / __DECIMATE_ROUNDS,
+                                   goal / faces);
+    }
+
+    std::vector<int> all;
+    M.region.assign(Nv, 0);
+    for (int v=0; v<Nv; ++v) {
+      if (!M.vfaces[v].empty()) all.push_back(v);
+    }
+    faces -= decimate_region(M, 0, all, faces, target);
+  }
+
+  // ---------------------------------------------------------------------------
+  // Gather the remaining triangles and the vertices they use.
+  // ---------------------------------------------------------------------------
+  std::vector<int> remap(Nv, -1);
+  out_indices.clear();
+  int Nout = 0;
+  for (int f=0; f<Nf; ++f) {
+    if (M.dead[f]) continue;
+    for (int k=0; k<3; ++k) {
+      const int v = M.tri[3*f + k];
+      if (remap[v] == -1) remap[v] = Nout++;
+      out_indices.push_back(remap[v]);
+    }
+  }
+  const int left = out_indices.size() / 3;
+
+  // The outputs must never be empty, so a mesh without triangles is given a
+  // single degenerate one.
+  verts.assign(__MESH_STRIDE*std::max(Nout, 1), 0.0);
+  if (out_indices.empty()) out_indices.assign(3, 0);
+
+  std::vector<double> normals(3*Nout, 0.0);
+  for (int f=0; f<Nf; ++f) {
+    if (M.dead[f]) continue;
+    const GLuint *v = &M.tri[3*f];
+    double n[3];
+    face_normal(&M.pos[3*v[0]], &M.pos[3*v[1]], &M.pos[3*v[2]], n);
+    for (int k=0; k<3; ++k) {
+      for (int d=0; d<3; ++d) normals[3*remap[v[k]] + d] += n[d];
+    }
+  }
+
+  // Agree with the input normals, taking the vote of all the vertices.
+  double vote = 0.0;
+  if (stride == __MESH_STRIDE) {
+    for (int v=0; v<Nv; ++v) {
+      if (remap[v] == -1) continue;
+      const GLfloat *u = input + stride*first[v] + 3;
+      const double *n = &normals[3*remap[v]];
+      vote += u[0]*n[0] + u[1]*n[1] + u[2]*n[2];
+    }
+  }
+  const double sign = vote < 0.0 ? -1.0 : 1.0;
+
+#pragma omp parallel for schedule(static)
+  for (int v=0; v<Nv; ++v) {
+    if (remap[v] == -1) continue;
+    GLfloat *x = &verts[__MESH_STRIDE*remap[v]];
+    const double *n = &normals[3*remap[v]];
+    const double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    for (int d=0; d<3; ++d) {
+      x[d] = M.pos[3*v + d];
+      x[3 + d] = len > 0.0 ? sign * n[d] / len : 0.0;
+    }
+    x[6] = M.scalars[v];
+  }
+
+  return left;
+}
+
+
+MeshDecimationSource::MeshDecimationSource()
+  : __target(10000),
+    __num_triangles(0)
+{
+
+}
+void MeshDecimationSource::__init_lua_objects()
+{
+  const char *names[] = { "triangles", "normals", "scalars" };
+  const int columns[] = { 0, 3, 6 };
+  const int widths[] = { 3, 3, 1 };
+  MeshSource *mesh = create<MeshSource>(__lua_state);
+
+  hold(__output_ds["mesh"] = mesh);
+  mesh->set_input(this);
+
+  for (int n=0; n<3; ++n) {
+    MeshAttribute *attr = create<MeshAttribute>(__lua_state);
+    hold(__output_ds[names[n]] = attr);
+    attr->set_columns(columns[n], widths[n]);
+    attr->set_input(mesh);
+  }
+}
+void MeshDecimationSource::set_target(int num_triangles)
+{
+  __target = num_triangles;
+  __staged = true;
+}
+
+void MeshDecimationSource::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_has_indices(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 2);
+
+  const int stride = __input_ds->get_num_points(1);
+  if (stride != 3 && stride != __MESH_STRIDE) {
+    luaL_error(__lua_state, "%s needs rows of 3 or %d columns", tname.c_str(),
+               __MESH_STRIDE);
+  }
+
+  const int Nin = __input_ds->get_num_points(0);
+  const GLuint *ind = __input_ds->get_indices();
+  const int Nind = __input_ds->get_num_indices();
+  for (int n=0; n<Nind; ++n) {
+    if (ind[n] >= (GLuint) Nin) {
+      luaL_error(__lua_state, "%s index %d out of range [0, %d)",
+                 tname.c_str(), (int) ind[n], Nin);
+    }
+  }
+
+  std::vector<GLfloat> verts;
+  std::vector<GLuint> indices;
+  __num_triangles = decimate_mesh(__input_ds->get_data(), stride, Nin, ind,
+                                  Nind, __target, verts, indices);
+
+  int Nvert[] = { (int) verts.size() / __MESH_STRIDE, __MESH_STRIDE };
+  __output_ds["mesh"]->set_data(&verts[0], Nvert, 2);
+  __output_ds["mesh"]->set_indices(&indices[0], indices.size());
+}
+
+
+MeshDecimationSource::LuaInstanceMethod
+MeshDecimationSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_target"] = _get_target_;
+  attr["set_target"] = _set_target_;
+  attr["get_num_triangles"] = _get_num_triangles_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int MeshDecimationSource::_get_target_(lua_State *L)
+{
+  MeshDecimationSource *self = checkarg<MeshDecimationSource>(L, 1);
+  lua_pushnumber(L, self->__target);
+  return 1;
+}
+int MeshDecimationSource::_set_target_(lua_State *L)
+{
+  MeshDecimationSource *self = checkarg<MeshDecimationSource>(L, 1);
+  const int target = luaL_checkinteger(L, 2);
+  if (target < 1) {
+    luaL_error(L, "target must be at least one triangle");
+  }
+  self->set_target(target);
+  return 0;
+}
+int MeshDecimationSource::_get_num_triangles_(lua_State *L)
+{
+  MeshDecimationSource *self = checkarg<MeshDecimationSource>(L, 1);
+  lua_pushnumber(L, self->__num_triangles);
+  return 1;
+}
@@ -1,5 +1,6 @@
 
 
+#include <algorithm>
 #include "luview.hpp"
 extern "C" {
 #define LUNUM_API_NOCOMPLEX
@@ -39,9 +40,16 @@ DataSource::DataSource()
     __texture_id(0),
     __vbo_id(0),
     __ibo_id(0),
+    __index_type(GL_UNSIGNED_INT),
+    __index_source(NULL),
+    __indices_staged(false),
     __texture_format(0),
     __num_dimensions(1),
     __num_indices(0),
+    __version(0),
+    __input_version(-1),
+    __bounds_version(-1),
+    __transform_version(-1),
     __normalize(false),
     __staged(true)
 {
@@ -60,19 +68,27 @@ DataSource::~DataSource()
   glDeleteBuffers(1, &__ibo_id);
 }
 
-bool DataSource::__ancestor_is_staged()
+bool DataSource::__side_inputs_changed()
+// -----------------------------------------------------------------------------
+// The cpu transform is a side input, since e.g. the parameters of an
+// ExpressionFunction may be changed after it has been set.
+// -----------------------------------------------------------------------------
 {
-  if (__input_ds == NULL) {
-    return false;
-  }
-  else {
-    return __input_ds->__staged || __input_ds->__ancestor_is_staged();
-  }
+  return __cpu_transform && __cpu_transform->get_version() != __transform_version;
 }
 void DataSource::__trigger_refresh()
+// -----------------------------------------------------------------------------
+// Refreshes the sources upstream, which is a no-op for those where nothing has
+// changed, and then this one if it is staged or any of its inputs has changed.
+// -----------------------------------------------------------------------------
 {
-  if (__ancestor_is_staged()) {
+  if (__input_ds) {
     __input_ds->__trigger_refresh();
+  }
+  if (__input_ds && __input_ds->__version != __input_version) {
+    __staged = true; // input was refreshed since our last refresh
+  }
+  if (__side_inputs_changed()) {
     __staged = true;
   }
   if (__staged) {
@@ -81,6 +97,9 @@ void DataSource::__trigger_refresh()
     __cp_cpu_to_gpu();
     //    __execute_gpu_transform();
     __staged = false;
+    ++__version;
+    if (__input_ds) __input_version = __input_ds->__version;
+    if (__cpu_transform) __transform_version = __cpu_transform->get_version();
   }
 }
 const GLfloat *DataSource::get_data()
@@ -89,7 +108,7 @@ const GLfloat *DataSource::get_data()
 }
 const GLuint *DataSource::get_indices()
 {
-  return __ind_data;
+  return __index_source ? __index_source->get_indices() : __ind_data;
 }
 GLuint DataSource::get_texture_id()
 {
@@ -111,7 +130,55 @@ int DataSource::get_num_points(int d)
   return d < __DATASOURCE_MAXDIMS ? __num_points[d] : 0;
 }
 int DataSource::get_num_dimensions() { return __num_dimensions; }
-int DataSource::get_num_indices() { return __num_indices; }
+int DataSource::get_num_indices()
+{
+  return __index_source ? __index_source->get_num_indices() : __num_indices;
+}
+GLuint DataSource::get_ibo()
+{
+  return __index_source ? __index_source->get_ibo() : __ibo_id;
+}
+GLenum DataSource::get_index_type()
+{
+  return __index_source ? __index_source->get_index_type() : __index_type;
+}
+const std::vector<DataSource::Meshlet> &DataSource::get_meshlets()
+{
+  return __index_source ? __index_source->get_meshlets() : __meshlets;
+}
+bool DataSource::get_bounds(double *lo, double *hi)
+// -----------------------------------------------------------------------------
+// Returns the axis aligned bounds of the first three columns of the data,
+// which are found again only when the buffers have been refreshed. Returns
+// false if the data is not a list of at least three dimensional positions.
+// -----------------------------------------------------------------------------
+{
+  if (__cpu_data == NULL || __num_dimensions != 2 || __num_points[1] < 3 ||
+      __num_points[0] == 0) {
+    return false;
+  }
+  if (__bounds_version != __version) {
+    const int N = __num_points[0];
+    const int M = __num_points[1];
+    for (int d=0; d<3; ++d) {
+      __bounds[d] = +1e16;
+      __bounds[d+3] = -1e16;
+    }
+    for (int n=0; n<N; ++n) {
+      for (int d=0; d<3; ++d) {
+        const double x = __cpu_data[M*n + d];
+        if (x < __bounds[d]) __bounds[d] = x;
+        if (x > __bounds[d+3]) __bounds[d+3] = x;
+      }
+    }
+    __bounds_version = __version;
+  }
+  for (int d=0; d<3; ++d) {
+    lo[d] = __bounds[d];
+    hi[d] = __bounds[d+3];
+  }
+  return true;
+}
 void DataSource::set_input(DataSource *inpt)
 {
   __input_ds = replace(__input_ds, inpt);
@@ -133,6 +200,10 @@ void DataSource::set_mode(const char *mode)
 }
 void DataSource::set_data(const GLfloat *data, const int *np, int nd)
 {
+  if (nd > __DATASOURCE_MAXDIMS) {
+    luaL_error(__lua_state, "data may have at most %d dimensions",
+               __DATASOURCE_MAXDIMS);
+  }
   __num_dimensions = nd;
   for (int i=0; i<__num_dimensions; ++i) __num_points[i] = np[i];
   size_t sz = this->get_size() * sizeof(GLfloat);
@@ -146,8 +217,13 @@ void DataSource::set_indices(const GLuint *indices, int ni)
   __ind_data = (GLuint*) realloc(__ind_data, sz);
   std::memcpy(__ind_data, indices, sz);
   __num_indices = ni;
+  __indices_staged = true;
   __staged = true;
 }
+void DataSource::share_indices(DataSource *src)
+{
+  __index_source = replace(__index_source, src);
+}
 void DataSource::check_num_dimensions(const char *name, int ndims)
 {
   if (ndims != __num_dimensions) {
@@ -170,7 +246,7 @@ void DataSource::check_has_data(const char *name)
 }
 void DataSource::check_has_indices(const char *name)
 {
-  if (__ind_data == NULL) {
+  if (get_indices() == NULL) {
     luaL_error(__lua_state, "%s must provide an index buffer", name);
   }
 }
@@ -186,6 +262,76 @@ void DataSource::compile()
 {
   __trigger_refresh();
 }
+void DataSource::__compact_indices(std::vector<GLushort> &compact)
+// -----------------------------------------------------------------------------
+// Splits the index buffer into meshlets whose vertices all lie within 65536 of
+// the meshlet's lowest one, so that the GPU copy may be stored as 16 bit
+// offsets from that base vertex. Meshlets are made of whole groups of six
+// indices, which never divides a triangle or a segment. If some group spans
+// too far, or there would be so many meshlets that the extra draw calls cost
+// more than they save, the indices stay 32 bit in a single meshlet.
+// -----------------------------------------------------------------------------
+{
+  const int N = __num_indices;
+  const GLuint span = 65535;
+  const GLuint *ind = __ind_data;
+  Meshlet m = { 0, 0, 0 };
+  GLuint lo = 0, hi = 0;
+  bool fits = true;
+
+  __meshlets.clear();
+
+  for (int k=0; k<N && fits; k+=6) {
+    const int end = std::min(k + 6, N);
+    GLuint glo = ind[k], ghi = ind[k];
+    for (int i=k+1; i<end; ++i) {
+      glo = std::min(glo, ind[i]);
+      ghi = std::max(ghi, ind[i]);
+    }
+    if (ghi - glo > span) {
+      fits = false;
+    }
+    else if (k == 0) {
+      lo = glo;
+      hi = ghi;
+    }
+    else if (std::max(hi, ghi) - std::min(lo, glo) > span) {
+      m.count = k - m.first;
+      m.base = lo;
+      __meshlets.push_back(m);
+      m.first = k;
+      lo = glo;
+      hi = ghi;
+    }
+    else {
+      lo = std::min(lo, glo);
+      hi = std::max(hi, ghi);
+    }
+  }
+  m.count = N - m.first;
+  m.base = lo;
+  __meshlets.push_back(m);
+
+  if (!fits || N == 0 || __meshlets.size() > 1 + (unsigned int) N / 4096) {
+    m.first = 0;
+    m.count = N;
+    m.base = 0;
+    __meshlets.assign(1, m);
+    __index_type = GL_UNSIGNED_INT;
+    return;
+  }
+
+  compact.resize(N);
+  const int M = __meshlets.size();
+#pragma omp parallel for schedule(static)
+  for (int n=0; n<M; ++n) {
+    const Meshlet &p = __meshlets[n];
+    for (int i=p.first; i<p.first + p.count; ++i) {
+      compact[i] = ind[i] - p.base;
+    }
+  }
+  __index_type = GL_UNSIGNED_SHORT;
+}
 void DataSource::__cp_cpu_to_gpu()
 {
   const int *N = __num_points;
@@ -201,11 +347,20 @@ void DataSource::__cp_cpu_to_gpu()
 		 GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
   }
-  if (__ind_data) {
+  if (__ind_data && __index_source == NULL && __indices_staged) {
+    std::vector<GLushort> compact;
+    __compact_indices(compact);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, __ibo_id);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Np*sizeof(GLuint), __ind_data,
-		 GL_STATIC_DRAW);
+    if (__index_type == GL_UNSIGNED_SHORT) {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, Np*sizeof(GLushort), &compact[0],
+                   GL_STATIC_DRAW);
+    }
+    else {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, Np*sizeof(GLuint), __ind_data,
+                   GL_STATIC_DRAW);
+    }
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    __indices_staged = false;
   }
 
 
@@ -404,7 +559,17 @@ int DataSource::_get_transform_(lua_State *L)
 int DataSource::_set_transform_(lua_State *L)
 {
   DataSource *self = checkarg<DataSource>(L, 1);
-  CallbackFunction *cb = checkarg<CallbackFunction>(L, 2);
+  static const char *modes[] = { "point", "batch", "parallel", NULL };
+  CallbackFunction *cb = CallbackFunction::create_from_stack(L, 2);
+  int mode = luaL_checkoption(L, 3, "point", modes);
+  if (mode != 0) {
+    LuaFunction *f = dynamic_cast<LuaFunction*>(cb);
+    if (f == NULL) {
+      luaL_error(L, "calling convention may only be given for Lua functions");
+    }
+    f->set_batched(mode == 1);
+    f->set_parallel(mode == 2 ? luaL_optinteger(L, 4, -1) : 0);
+  }
   self->__cpu_transform = self->replace(self->__cpu_transform, cb);
   self->__staged = true;
   return 0;
@@ -443,10 +608,11 @@ GridSource2D::GridSource2D()
 
 void GridSource2D::__refresh_cpu()
 {
-  __num_dimensions = 2;
+  __num_dimensions = 3;
   __num_indices = 0;
   __num_points[0] = Nu;
   __num_points[1] = Nv;
+  __num_points[2] = 2;
   __cpu_data = (GLfloat*) realloc(__cpu_data, 2*Nu*Nv*sizeof(GLfloat));
 
   const int su = Nv;
@@ -498,21 +664,151 @@ int GridSource2D::_set_v_range_(lua_State *L)
 }
 
 
-ParametricVertexSource3D::ParametricVertexSource3D()
-  : GridSource2D()
+PointsSource::PointsSource()
+{
+  __num_dimensions = 2;
+}
+void PointsSource::set_points(const double *x, int N, int dim)
+// -----------------------------------------------------------------------------
+// Sets the data to the N points of dimension `dim` stored contiguously in x.
+// -----------------------------------------------------------------------------
+{
+  const int np[2] = { N, dim };
+  __cpu_data = (GLfloat*) realloc(__cpu_data, N*dim*sizeof(GLfloat));
+  for (int n=0; n<N*dim; ++n) __cpu_data[n] = x[n];
+  __num_dimensions = 2;
+  for (int i=0; i<2; ++i) __num_points[i] = np[i];
+  __staged = true;
+}
+PointsSource::LuaInstanceMethod
+PointsSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["set_points"] = _set_points_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int PointsSource::_set_points_(lua_State *L)
+{
+  PointsSource *self = checkarg<PointsSource>(L, 1);
+  if (lunum_upcast(L, 2, ARRAY_TYPE_DOUBLE, 1)) {
+    lua_replace(L, 2);
+  }
+  Array *A = lunum_checkarray1(L, 2);
+  if (A->ndims != 2) {
+    luaL_error(L, "points must be a 2d array with shape (N,dim)");
+  }
+  Array B = array_new_copy(A, ARRAY_TYPE_DOUBLE);
+  self->set_points((double*)B.data, A->shape[0], A->shape[1]);
+  array_del(&B);
+  return 0;
+}
+
+
+FunctionMapping::FunctionMapping()
+{
+
+}
+void FunctionMapping::__refresh_cpu()
+// -----------------------------------------------------------------------------
+// Applies the cpu transform to each point of the input. The last axis of the
+// input holds the arguments, and the last axis of the output holds the values
+// returned, e.g. a (Nu,Nv,2) grid mapped by f(u,v) -> x,y,z gives (Nu,Nv,3).
+// -----------------------------------------------------------------------------
 {
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  if (__cpu_transform == NULL) {
+    luaL_error(__lua_state, "need a transform function\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+
+  const int nd = __input_ds->get_num_dimensions();
+  const int narg = nd == 1 ? 1 : __input_ds->get_num_points(nd-1);
+  const int N = __input_ds->get_size() / narg;
+  const GLfloat *input = __input_ds->get_data();
+  int nret = 0;
+
+  if (__cpu_transform->supports_batch()) {
+    std::vector<double> X(narg*N);
+    std::vector<double> Y;
+    for (int n=0; n<N; ++n) {
+      for (int k=0; k<narg; ++k) X[k*N + n] = input[n*narg + k];
+    }
+    nret = __cpu_transform->call_batch(&X[0], narg, N, Y);
+    __cpu_data = (GLfloat*) realloc(__cpu_data, N*nret*sizeof(GLfloat));
+    for (int n=0; n<N; ++n) {
+      for (int k=0; k<nret; ++k) __cpu_data[n*nret + k] = Y[k*N + n];
+    }
+  }
+  else {
+    double X[__CALLBACK_MAXARGS];
+    double Y[__CALLBACK_MAXARGS];
+    if (narg > __CALLBACK_MAXARGS) {
+      luaL_error(__lua_state, "transform input has %d components, at most %d "
+                 "are supported", narg, __CALLBACK_MAXARGS);
+    }
+    for (int n=0; n<N; ++n) {
+      for (int k=0; k<narg; ++k) X[k] = input[n*narg + k];
+      const int m = __cpu_transform->call(X, narg, Y);
+      if (n == 0) {
+        nret = m;
+        __cpu_data = (GLfloat*) realloc(__cpu_data, N*nret*sizeof(GLfloat));
+      }
+      else if (m != nret) {
+        luaL_error(__lua_state, "transform returned %d values, expected %d",
+                   m, nret);
+      }
+      for (int k=0; k<nret; ++k) __cpu_data[n*nret + k] = Y[k];
+    }
+  }
+  if (nret == 0) {
+    luaL_error(__lua_state, "transform must return at least one value");
+  }
 
+  if (nd == 1) {
+    __num_dimensions = nret == 1 ? 1 : 2;
+    __num_points[0] = N;
+    __num_points[1] = nret;
+  }
+  else {
+    __num_dimensions = nd;
+    for (int i=0; i<nd-1; ++i) __num_points[i] = __input_ds->get_num_points(i);
+    __num_points[nd-1] = nret;
+  }
+}
+
+
+ParametricVertexSource3D::ParametricVertexSource3D()
+  : GridSource2D(), __built_Nu(0), __built_Nv(0)
+{
+  for (int i=0; i<4; ++i) __built_range[i] = 0.0;
 }
 void ParametricVertexSource3D::__init_lua_objects()
 {
-  hold(__output_ds["triangles"] = create<DataSource>(__lua_state));
-  hold(__output_ds["normals"] = create<DataSource>(__lua_state));
-  hold(__output_ds["scalars"] = create<DataSource>(__lua_state));
-  __output_ds["triangles"]->set_input(this);
-  __output_ds["normals"]->set_input(this);
-  __output_ds["scalars"]->set_input(this);
+  const char *names[] = { "triangles", "normals", "scalars" };
+  const int columns[] = { 0, 3, 6 };
+  const int widths[] = { 3, 3, 1 };
+  MeshSource *mesh = create<MeshSource>(__lua_state);
+
+  hold(__output_ds["mesh"] = mesh);
+  mesh->set_input(this);
+
+  for (int n=0; n<3; ++n) {
+    MeshAttribute *attr = create<MeshAttribute>(__lua_state);
+    hold(__output_ds[names[n]] = attr);
+    attr->set_columns(columns[n], widths[n]);
+    attr->set_input(mesh);
+  }
 }
 void ParametricVertexSource3D::__refresh_cpu()
+// -----------------------------------------------------------------------------
+// Fills the interleaved mesh in parallel over rows of the grid. The vertex
+// buffer is kept between refreshes, so x and y are only recomputed when the
+// grid size or range changes, and indices only when the grid size changes;
+// otherwise just z, the normals and the scalars are.
+// -----------------------------------------------------------------------------
 {
   if (__input_ds == NULL) {
     luaL_error(__lua_state, "need an input data source\n");
@@ -524,26 +820,38 @@ void ParametricVertexSource3D::__refresh_cpu()
   Nu = __input_ds->get_num_points(0);
   Nv = __input_ds->get_num_points(1);
 
-  std::vector<GLfloat> verts(3*Nu*Nv);
-  std::vector<GLfloat> normals;
-  std::vector<GLfloat> scalars;
-  std::vector<GLuint> indices;
+  if (Nu < 2 || Nv < 2) {
+    luaL_error(__lua_state, "%s needs at least 2x2 points", tname.c_str());
+  }
+  const bool resized = Nu != __built_Nu || Nv != __built_Nv;
+  const bool moved = resized ||
+    u0 != __built_range[0] || u1 != __built_range[1] ||
+    v0 != __built_range[2] || v1 != __built_range[3];
+
+  if (resized) {
+    __verts.resize(__MESH_STRIDE*Nu*Nv);
+  }
 
   const GLfloat *input = __input_ds->get_data();
+  GLfloat *verts = &__verts[0];
   const int su = Nv;
   const int sv = 1;
   const double du = (u1 - u0) / (Nu - 1);
   const double dv = (v1 - v0) / (Nv - 1);
 
+#pragma omp parallel for schedule(static)
   for (int i=0; i<Nu; ++i) {
     for (int j=0; j<Nv; ++j) {
       const int m = i*su + j*sv;
-      verts[3*m + 0] = u0 + i*du;
-      verts[3*m + 1] = v0 + j*dv;
-      verts[3*m + 2] = input[m];
+      if (moved) {
+        verts[__MESH_STRIDE*m + 0] = u0 + i*du;
+        verts[__MESH_STRIDE*m + 1] = v0 + j*dv;
+      }
+      verts[__MESH_STRIDE*m + 2] = input[m];
     }
   }
 
+#pragma omp parallel for schedule(static)
   for (int i=0; i<Nu; ++i) {
     for (int j=0; j<Nv; ++j) {
       const int i0 = i==0    ?    0 : i-1;
@@ -554,41 +862,123 @@ void ParametricVertexSource3D::__refresh_cpu()
       const int mu = i0*su + j0*sv;
       const int mv = i0*su + j1*sv;
       const int mw = i1*su + j0*sv;
-      const int mq = i1*su + j1*sv;
 
-      const GLfloat *u = &verts[3*mu];
-      const GLfloat *v = &verts[3*mv];
-      const GLfloat *w = &verts[3*mw];
+      const GLfloat *u = &verts[__MESH_STRIDE*mu];
+      const GLfloat *v = &verts[__MESH_STRIDE*mv];
+      const GLfloat *w = &verts[__MESH_STRIDE*mw];
 
       const GLfloat d1[3] = {v[0]-u[0], v[1]-u[1], v[2]-u[2]};
       const GLfloat d2[3] = {w[0]-v[0], w[1]-v[1], w[2]-v[2]};
 
-      normals.push_back(d1[2]*d2[1] - d1[1]*d2[2]);
-      normals.push_back(d1[0]*d2[2] - d1[2]*d2[0]);
-      normals.push_back(d1[1]*d2[0] - d1[0]*d2[1]);
+      GLfloat *x = &verts[__MESH_STRIDE*m0];
+      x[3] = d1[2]*d2[1] - d1[1]*d2[2];
+      x[4] = d1[0]*d2[2] - d1[2]*d2[0];
+      x[5] = d1[1]*d2[0] - d1[0]*d2[1];
+      x[6] = x[2]; // take scalars as last component for now
+    }
+  }
 
-      indices.push_back(mv);
-      indices.push_back(mu);
-      indices.push_back(mw);
+  int Nvert[] = { Nu*Nv, __MESH_STRIDE };
+  __output_ds["mesh"]->set_data(verts, Nvert, 2);
+  static_cast<MeshSource*>(__output_ds["mesh"])->set_grid_shape(Nu, Nv);
+
+  if (resized) {
+    std::vector<GLuint> indices(6*Nu*Nv);
+
+#pragma omp parallel for schedule(static)
+    for (int i=0; i<Nu; ++i) {
+      for (int j=0; j<Nv; ++j) {
+        const int i0 = i==0    ?    0 : i-1;
+        const int i1 = i==Nu-1 ? Nu-1 : i+1;
+        const int j0 = j==0    ?    0 : j-1;
+        const int j1 = j==Nv-1 ? Nv-1 : j+1;
+        GLuint *t = &indices[6*(i*su + j*sv)];
+        t[0] = i0*su + j1*sv;
+        t[1] = i0*su + j0*sv;
+        t[2] = i1*su + j0*sv;
+        t[3] = i0*su + j1*sv;
+        t[4] = i1*su + j0*sv;
+        t[5] = i1*su + j1*sv;
+      }
+    }
+    __output_ds["mesh"]->set_indices(&indices[0], indices.size());
+  }
 
-      indices.push_back(mv);
-      indices.push_back(mw);
-      indices.push_back(mq);
+  __built_Nu = Nu;
+  __built_Nv = Nv;
+  __built_range[0] = u0;
+  __built_range[1] = u1;
+  __built_range[2] = v0;
+  __built_range[3] = v1;
+}
 
-      scalars.push_back(verts[3*m0+2]); // take scalars as last component for now
-    }
+
+MeshSource::MeshSource()
+{
+  __grid_shape[0] = 0;
+  __grid_shape[1] = 0;
+}
+void MeshSource::set_grid_shape(int Nu, int Nv)
+{
+  __grid_shape[0] = Nu;
+  __grid_shape[1] = Nv;
+}
+int MeshSource::get_grid_shape(int d)
+{
+  return __grid_shape[d];
+}
+void MeshSource::__do_normalize()
+{
+  if (!__normalize || __cpu_data == NULL) return;
+
+  const int N = __num_points[0];
+  double xmin = +1e16;
+  double xmax = -1e16;
+  for (int n=0; n<N; ++n) {
+    const GLfloat x = __cpu_data[__MESH_STRIDE*n + 6];
+    if (x > xmax) xmax = x;
+    if (x < xmin) xmin = x;
+  }
+  for (int n=0; n<N; ++n) {
+    GLfloat &x = __cpu_data[__MESH_STRIDE*n + 6];
+    x = (x - xmin) / (xmax - xmin);
   }
+}
 
-  int Nvert[] = { verts.size()/3, 3 };
-  int Nnorm[] = { normals.size()/3, 3 };
-  int Nscal[] = { scalars.size() };
 
-  __output_ds["triangles"]->set_data(&verts[0], Nvert, 2);
-  __output_ds["triangles"]->set_indices(&indices[0], indices.size());
+MeshAttribute::MeshAttribute() : __column(0), __num_columns(1)
+{
 
-  __output_ds["normals"]->set_data(&normals[0], Nnorm, 2);
-  __output_ds["normals"]->set_indices(&indices[0], indices.size());
+}
+void MeshAttribute::set_columns(int column, int num_columns)
+{
+  __column = column;
+  __num_columns = num_columns;
+  __staged = true;
+}
+void MeshAttribute::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 2);
+  __input_ds->check_num_points(tname.c_str(), __MESH_STRIDE, 1);
+
+  const int N = __input_ds->get_num_points(0);
+  const GLfloat *mesh = __input_ds->get_data();
+
+  __cpu_data = (GLfloat*) realloc(__cpu_data,
+                                  N*__num_columns*sizeof(GLfloat));
+  for (int n=0; n<N; ++n) {
+    for (int k=0; k<__num_columns; ++k) {
+      __cpu_data[n*__num_columns + k] = mesh[__MESH_STRIDE*n + __column + k];
+    }
+  }
+  __num_dimensions = __num_columns == 1 ? 1 : 2;
+  __num_points[0] = N;
+  __num_points[1] = __num_columns == 1 ? 0 : __num_columns;
 
-  __output_ds["scalars"]->set_data(&scalars[0], Nscal, 1);
-  __output_ds["scalars"]->set_indices(&indices[0], indices.size());
+  share_indices(__input_ds);
 }
@@ -0,0 +1,432 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * ExpressionFunction: a CallbackFunction defined by a comma separated list of
+ * arithmetic expressions in the arguments u, v, w, for example
+ *
+ *                   "u, v, 0.1*cos(6*u + t)*exp(-(u^2 + v^2))"
+ *
+ * The expressions are parsed once into a small stack bytecode, which is then
+ * evaluated on blocks of points at a time, in parallel over blocks, without
+ * involving Lua. Named parameters like `t` above must be declared with
+ * set_parameter before the expression is set, and may be changed afterwards,
+ * which restages the DataSources using the function.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include "luview.hpp"
+
+#define __EXPR_BLOCK 64 // number of points evaluated at a time
+#define __EXPR_MAXDEPTH 32 // deepest stack an expression may use
+
+
+enum { OP_CONST, OP_ARG, OP_PARAM, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW,
+       OP_NEG, OP_FUNC1, OP_FUNC2 };
+
+static double absval(double x) { return fabs(x); }
+static double minval(double x, double y) { return x < y ? x : y; }
+static double maxval(double x, double y) { return x > y ? x : y; }
+
+struct Function1
+{
+  const char *name;
+  double (*f)(double);
+} ;
+struct Function2
+{
+  const char *name;
+  double (*f)(double, double);
+} ;
+static Function1 functions1[] =
+  {{"sin", sin}, {"cos", cos}, {"tan", tan},
+   {"asin", asin}, {"acos", acos}, {"atan", atan},
+   {"sinh", sinh}, {"cosh", cosh}, {"tanh", tanh},
+   {"exp", exp}, {"log", log}, {"log10", log10}, {"sqrt", sqrt},
+   {"abs", absval}, {"floor", floor}, {"ceil", ceil},
+   {NULL, NULL}};
+static Function2 functions2[] =
+  {{"pow", pow}, {"atan2", atan2}, {"fmod", fmod},
+   {"min", minval}, {"max", maxval},
+   {NULL, NULL}};
+
+
+class ExpressionParser
+// -----------------------------------------------------------------------------
+// Recursive descent parser emitting stack bytecode. Throws a std::string
+// describing the problem if the source is not a valid expression list.
+//
+// list    := expr (',' expr)*
+// expr    := term (('+' | '-') term)*
+// term    := unary (('*' | '/') unary)*
+// unary   := '-' unary | power
+// power   := primary ('^' unary)?
+// primary := number | name | name '(' expr (',' expr)? ')' | '(' expr ')'
+// -----------------------------------------------------------------------------
+{
+public:
+  typedef ExpressionFunction::Instruction Instruction;
+  typedef ExpressionFunction::Program Program;
+
+  ExpressionParser(const char *src,
+                   std::vector<double> &constants,
+                   const std::map<std::string, int> &params)
+    : src(src), pos(src), constants(constants), params(params),
+      depth(0), max_depth(0), max_arg(-1) { }
+
+  void parse(std::vector<Program> &programs)
+  {
+    do {
+      program.clear();
+      depth = 0;
+      expr();
+      programs.push_back(program);
+    } while (accept(','));
+    skip_space();
+    if (*pos != '\0') fail("unexpected character");
+  }
+  int get_max_depth() { return max_depth; }
+  int get_max_arg() { return max_arg; }
+
+private:
+  const char *src, *pos;
+  std::vector<double> &constants;
+  const std::map<std::string, int> &params;
+  Program program;
+  int depth, max_depth, max_arg;
+
+  void fail(const char *msg)
+  {
+    std::stringstream ss;
+    ss<<msg<<" at position "<<(pos - src)<<" in '"<<src<<"'";
+    throw ss.str();
+  }
+  void skip_space()
+  {
+    while (isspace(*pos)) ++pos;
+  }
+  bool accept(char c)
+  {
+    skip_space();
+    if (*pos == c) {
+      ++pos;
+      return true;
+    }
+    return false;
+  }
+  void emit(int op, int arg, int push)
+  {
+    Instruction ins = { op, arg };
+    program.push_back(ins);
+    depth += push;
+    if (depth > max_depth) max_depth = depth;
+  }
+  void expr()
+  {
+    term();
+    while (true) {
+      if      (accept('+')) { term(); emit(OP_ADD, 0, -1); }
+      else if (accept('-')) { term(); emit(OP_SUB, 0, -1); }
+      else break;
+    }
+  }
+  void term()
+  {
+    unary();
+    while (true) {
+      if      (accept('*')) { unary(); emit(OP_MUL, 0, -1); }
+      else if (accept('/')) { unary(); emit(OP_DIV, 0, -1); }
+      else break;
+    }
+  }
+  void unary()
+  {
+    if (accept('-')) {
+      unary();
+      emit(OP_NEG, 0, 0);
+    }
+    else {
+      power();
+    }
+  }
+  void power()
+  {
+    primary();
+    if (accept('^')) {
+      unary();
+      emit(OP_POW, 0, -1);
+    }
+  }
+  void primary()
+  {
+    skip_space();
+    if (accept('(')) {
+      expr();
+      if (!accept(')')) fail("expected ')'");
+    }
+    else if (isdigit(*pos) || *pos == '.') {
+      char *end;
+      double x = strtod(pos, &end);
+      pos = end;
+      constants.push_back(x);
+      emit(OP_CONST, constants.size() - 1, +1);
+    }
+    else if (isalpha(*pos) || *pos == '_') {
+      const char *start = pos;
+      while (isalnum(*pos) || *pos == '_') ++pos;
+      std::string name(start, pos);
+      if (accept('(')) {
+        call(name);
+      }
+      else {
+        symbol(name);
+      }
+    }
+    else {
+      fail("expected a number, name or '('");
+    }
+  }
+  void call(const std::string &name)
+  {
+    for (int n=0; functions1[n].name; ++n) {
+      if (name == functions1[n].name) {
+        expr();
+        if (!accept(')')) fail("expected ')'");
+        emit(OP_FUNC1, n, 0);
+        return;
+      }
+    }
+    for (int n=0; functions2[n].name; ++n) {
+      if (name == functions2[n].name) {
+        expr();
+        if (!accept(',')) fail("expected ','");
+        expr();
+        if (!accept(')')) fail("expected ')'");
+        emit(OP_FUNC2, n, -1);
+        return;
+      }
+    }
+    fail(("unknown function " + name).c_str());
+  }
+  void symbol(const std::string &name)
+  {
+    const char *args[] = { "u", "v", "w" };
+    const char *alts[] = { "x", "y", "z" };
+    for (int k=0; k<3; ++k) {
+      if (name == args[k] || name == alts[k]) {
+        if (k > max_arg) max_arg = k;
+        emit(OP_ARG, k, +1);
+        return;
+      }
+    }
+    std::map<std::string, int>::const_iterator p = params.find(name);
+    if (p != params.end()) {
+      emit(OP_PARAM, p->second, +1);
+    }
+    else if (name == "pi") {
+      constants.push_back(M_PI);
+      emit(OP_CONST, constants.size() - 1, +1);
+    }
+    else if (name == "e") {
+      constants.push_back(M_E);
+      emit(OP_CONST, constants.size() - 1, +1);
+    }
+    else {
+      fail(("unknown symbol " + name).c_str());
+    }
+  }
+} ;
+
+
+ExpressionFunction::ExpressionFunction() : stack_depth(0), num_args(0) { }
+
+void ExpressionFunction::set_expression(const char *expr)
+{
+  std::vector<Program> new_programs;
+  std::vector<double> new_constants;
+  ExpressionParser parser(expr, new_constants, param_index);
+  std::string error;
+  try {
+    parser.parse(new_programs);
+  }
+  catch (std::string &msg) {
+    error = msg;
+  }
+  if (error.empty() && parser.get_max_depth() > __EXPR_MAXDEPTH) {
+    error = "expression is nested too deeply";
+  }
+  if (error.empty() && new_programs.size() > __CALLBACK_MAXARGS) {
+    error = "expression list is too long";
+  }
+  if (!error.empty()) {
+    luaL_error(__lua_state, "%s", error.c_str());
+  }
+  expression = expr;
+  programs = new_programs;
+  constants = new_constants;
+  stack_depth = parser.get_max_depth();
+  num_args = parser.get_max_arg() + 1;
+  ++version;
+}
+void ExpressionFunction::set_parameter(const char *name, double value)
+{
+  std::map<std::string, int>::iterator p = param_index.find(name);
+  if (p == param_index.end()) {
+    param_index[name] = params.size();
+    params.push_back(value);
+  }
+  else {
+    params[p->second] = value;
+  }
+  ++version;
+}
+
+void ExpressionFunction::evaluate(const double *x, int N, int n0, int nb,
+                                  double *stack, double *res)
+// -----------------------------------------------------------------------------
+// Evaluates every output expression for the points n0 ... n0+nb-1, where nb is
+// at most __EXPR_BLOCK. Arguments and results are in columns of length N.
+// -----------------------------------------------------------------------------
+{
+  const int B = __EXPR_BLOCK;
+
+  for (unsigned int k=0; k<programs.size(); ++k) {
+    const Program &P = programs[k];
+    int sp = -1;
+
+    for (unsigned int m=0; m<P.size(); ++m) {
+      const Instruction &ins = P[m];
+      double *a, *b;
+
+      switch (ins.op) {
+      case OP_CONST: {
+        const double c = constants[ins.arg];
+        a = stack + (++sp)*B;
+        for (int i=0; i<nb; ++i) a[i] = c;
+      } break;
+      case OP_PARAM: {
+        const double c = params[ins.arg];
+        a = stack + (++sp)*B;
+        for (int i=0; i<nb; ++i) a[i] = c;
+      } break;
+      case OP_ARG: {
+        const double *xk = x + ins.arg*N + n0;
+        a = stack + (++sp)*B;
+        for (int i=0; i<nb; ++i) a[i] = xk[i];
+      } break;
+      case OP_NEG:
+        a = stack + sp*B;
+        for (int i=0; i<nb; ++i) a[i] = -a[i];
+        break;
+      case OP_FUNC1: {
+        double (*f)(double) = functions1[ins.arg].f;
+        a = stack + sp*B;
+        for (int i=0; i<nb; ++i) a[i] = f(a[i]);
+      } break;
+      default: // binary operations
+        b = stack + (sp--)*B;
+        a = stack + sp*B;
+        switch (ins.op) {
+        case OP_ADD: for (int i=0; i<nb; ++i) a[i] += b[i]; break;
+        case OP_SUB: for (int i=0; i<nb; ++i) a[i] -= b[i]; break;
+        case OP_MUL: for (int i=0; i<nb; ++i) a[i] *= b[i]; break;
+        case OP_DIV: for (int i=0; i<nb; ++i) a[i] /= b[i]; break;
+        case OP_POW: for (int i=0; i<nb; ++i) a[i] = pow(a[i], b[i]); break;
+        case OP_FUNC2: {
+          double (*f)(double, double) = functions2[ins.arg].f;
+          for (int i=0; i<nb; ++i) a[i] = f(a[i], b[i]);
+        } break;
+        }
+        break;
+      }
+    }
+    std::copy(stack, stack + nb, res + k*N + n0);
+  }
+}
+
+int ExpressionFunction::call_priv(const double *x, int narg, double *res)
+{
+  if (programs.empty()) {
+    luaL_error(__lua_state, "no expression has been set");
+  }
+  if (narg < num_args) {
+    luaL_error(__lua_state, "expression needs %d arguments, got %d",
+               num_args, narg);
+  }
+  double stack[__EXPR_MAXDEPTH*__EXPR_BLOCK];
+  evaluate(x, 1, 0, 1, stack, res);
+  return programs.size();
+}
+int ExpressionFunction::call_batch_priv(const double *x, int narg, int N,
+                                        std::vector<double> &res)
+{
+  if (programs.empty()) {
+    luaL_error(__lua_state, "no expression has been set");
+  }
+  if (narg < num_args) {
+    luaL_error(__lua_state, "expression needs %d arguments, got %d",
+               num_args, narg);
+  }
+  const int B = __EXPR_BLOCK;
+  const int nblocks = (N + B - 1) / B;
+  res.resize(programs.size()*N);
+
+#pragma omp parallel
+  {
+    std::vector<double> stack(stack_depth*B);
+#pragma omp for schedule(static)
+    for (int b=0; b<nblocks; ++b) {
+      const int n0 = b*B;
+      const int nb = N - n0 < B ? N - n0 : B;
+      evaluate(x, N, n0, nb, &stack[0], &res[0]);
+    }
+  }
+  return programs.size();
+}
+
+
+ExpressionFunction::LuaInstanceMethod
+ExpressionFunction::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_expression"] = _get_expression_;
+  attr["set_expression"] = _set_expression_;
+  attr["get_parameter"] = _get_parameter_;
+  attr["set_parameter"] = _set_parameter_;
+  RETURN_ATTR_OR_CALL_SUPER(CallbackFunction);
+}
+int ExpressionFunction::_get_expression_(lua_State *L)
+{
+  ExpressionFunction *self = checkarg<ExpressionFunction>(L, 1);
+  lua_pushstring(L, self->expression.c_str());
+  return 1;
+}
+int ExpressionFunction::_set_expression_(lua_State *L)
+{
+  ExpressionFunction *self = checkarg<ExpressionFunction>(L, 1);
+  self->set_expression(luaL_checkstring(L, 2));
+  return 0;
+}
+int ExpressionFunction::_get_parameter_(lua_State *L)
+{
+  ExpressionFunction *self = checkarg<ExpressionFunction>(L, 1);
+  const char *name = luaL_checkstring(L, 2);
+  std::map<std::string, int>::iterator p = self->param_index.find(name);
+  if (p == self->param_index.end()) {
+    lua_pushnil(L);
+  }
+  else {
+    lua_pushnumber(L, self->params[p->second]);
+  }
+  return 1;
+}
+int ExpressionFunction::_set_parameter_(lua_State *L)
+{
+  ExpressionFunction *self = checkarg<ExpressionFunction>(L, 1);
+  const char *name = luaL_checkstring(L, 2);
+  self->set_parameter(name, luaL_checknumber(L, 3));
+  return 0;
+}
@@ -0,0 +1,98 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * FrameBuffer: an offscreen render target made of one color texture and a
+ * depth renderbuffer, which may be shared with another FrameBuffer so that
+ * several color targets can be drawn against the same depth.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include "luview.hpp"
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glext.h>
+#define glBindFramebuffer glBindFramebufferEXT
+#define glGenRenderbuffers glGenRenderbuffersEXT
+#define glGenFramebuffers glGenFramebuffersEXT
+#define glDeleteRenderbuffers glDeleteRenderbuffersEXT
+#define glDeleteFramebuffers glDeleteFramebuffersEXT
+#define glRenderbufferStorage glRenderbufferStorageEXT
+#define glFramebufferRenderbuffer glFramebufferRenderbufferEXT
+#define glBindRenderbuffer glBindRenderbufferEXT
+#define glFramebufferTexture2D glFramebufferTexture2DEXT
+#define glCheckFramebufferStatus glCheckFramebufferStatusEXT
+
+#define GL_FRAMEBUFFER GL_FRAMEBUFFER_EXT
+#define GL_RENDERBUFFER GL_RENDERBUFFER_EXT
+#define GL_DEPTH_ATTACHMENT GL_DEPTH_ATTACHMENT_EXT
+#define GL_COLOR_ATTACHMENT0 GL_COLOR_ATTACHMENT0_EXT
+#define GL_FRAMEBUFFER_COMPLETE GL_FRAMEBUFFER_COMPLETE_EXT
+
+
+FrameBuffer::FrameBuffer(bool floating, FrameBuffer *depth_from)
+  : format(floating ? GL_RGBA16F_ARB : GL_RGBA8),
+    depth_from(depth_from),
+    width(0),
+    height(0),
+    previous(0)
+{
+  glGenFramebuffers(1, &fbo);
+  glGenTextures(1, &texture);
+  glGenRenderbuffers(1, &depth);
+}
+FrameBuffer::~FrameBuffer()
+{
+  glDeleteRenderbuffers(1, &depth);
+  glDeleteTextures(1, &texture);
+  glDeleteFramebuffers(1, &fbo);
+}
+bool FrameBuffer::resize(int w, int h)
+// -----------------------------------------------------------------------------
+// Reallocates the attachments if the size has changed. A FrameBuffer sharing
+// the depth of another must be resized after it. Returns false if the driver
+// does not accept the combination of attachments.
+// -----------------------------------------------------------------------------
+{
+  const GLuint depth_id = depth_from ? depth_from->depth : depth;
+  if (w == width && h == height) return true;
+  width = w;
+  height = h;
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (depth_from == NULL) {
+    glBindRenderbuffer(GL_RENDERBUFFER, depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  }
+
+  bind();
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         texture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth_id);
+  const bool complete =
+    glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  release();
+  return complete;
+}
+void FrameBuffer::bind()
+{
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING_EXT, &previous);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+void FrameBuffer::release()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+void FrameBuffer::unbind()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,137 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * ViewFrustum: culling of axis aligned boxes against the view volume, and the
+ * few matrix operations needed to find it on the CPU without asking OpenGL.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include "luview.hpp"
+
+
+ViewFrustum::ViewFrustum(const double *PM)
+// -----------------------------------------------------------------------------
+// Extracts the planes from the rows of PM, the matrix taking the coordinates
+// of the boxes to be tested to clip space. A point is inside a plane (a,b,c,d)
+// when a*x + b*y + c*z + d >= 0.
+// -----------------------------------------------------------------------------
+{
+  for (int i=0; i<3; ++i) {
+    for (int k=0; k<4; ++k) {
+      planes[2*i + 0][k] = PM[4*k + 3] + PM[4*k + i];
+      planes[2*i + 1][k] = PM[4*k + 3] - PM[4*k + i];
+    }
+  }
+}
+bool ViewFrustum::intersects(const double *lo, const double *hi) const
+// -----------------------------------------------------------------------------
+// Returns false only if the box lies entirely outside one of the planes. Boxes
+// near the corners of the frustum may be reported as visible when they are
+// not, which is harmless.
+// -----------------------------------------------------------------------------
+{
+  for (int n=0; n<6; ++n) {
+    const double *p = planes[n];
+    const double x = p[0] > 0.0 ? hi[0] : lo[0];
+    const double y = p[1] > 0.0 ? hi[1] : lo[1];
+    const double z = p[2] > 0.0 ? hi[2] : lo[2];
+    if (p[0]*x + p[1]*y + p[2]*z + p[3] < 0.0) return false;
+  }
+  return true;
+}
+
+void ViewFrustum::identity(double *M)
+{
+  for (int k=0; k<16; ++k) M[k] = k % 5 == 0 ? 1.0 : 0.0;
+}
+void ViewFrustum::multiply(const double *A, const double *B, double *C)
+// -----------------------------------------------------------------------------
+// C = A B, where C may not alias A or B.
+// -----------------------------------------------------------------------------
+{
+  for (int j=0; j<4; ++j) {
+    for (int i=0; i<4; ++i) {
+      C[4*j + i] = (A[0*4 + i] * B[4*j + 0] + A[1*4 + i] * B[4*j + 1] +
+                    A[2*4 + i] * B[4*j + 2] + A[3*4 + i] * B[4*j + 3]);
+    }
+  }
+}
+void ViewFrustum::translate(double *M, double x, double y, double z)
+{
+  for (int i=0; i<4; ++i) {
+    M[12 + i] += M[0 + i]*x + M[4 + i]*y + M[8 + i]*z;
+  }
+}
+void ViewFrustum::scale(double *M, double x, double y, double z)
+{
+  for (int i=0; i<4; ++i) {
+    M[0 + i] *= x;
+    M[4 + i] *= y;
+    M[8 + i] *= z;
+  }
+}
+void ViewFrustum::rotate(double *M, double angle, int axis)
+// -----------------------------------------------------------------------------
+// Rotates by `angle` degrees about the x, y or z axis, for `axis` 0, 1 or 2.
+// -----------------------------------------------------------------------------
+{
+  const double t = angle * M_PI / 180.0;
+  const double c = cos(t), s = sin(t);
+  const int a = (axis + 1) % 3; // the two columns mixed by the rotation
+  const int b = (axis + 2) % 3;
+
+  for (int i=0; i<4; ++i) {
+    const double ma = M[4*a + i];
+    const double mb = M[4*b + i];
+    M[4*a + i] =  c*ma + s*mb;
+    M[4*b + i] = -s*ma + c*mb;
+  }
+}
+bool ViewFrustum::invert(const double *M, double *Minv)
+// -----------------------------------------------------------------------------
+// Inverts M by cofactor expansion. Returns false, leaving Minv unchanged, if M
+// is singular.
+// -----------------------------------------------------------------------------
+{
+  double A[16];
+
+  A[ 0] =  M[5]*M[10]*M[15] - M[5]*M[11]*M[14] - M[9]*M[6]*M[15]
+    + M[9]*M[7]*M[14] + M[13]*M[6]*M[11] - M[13]*M[7]*M[10];
+  A[ 4] = -M[4]*M[10]*M[15] + M[4]*M[11]*M[14] + M[8]*M[6]*M[15]
+    - M[8]*M[7]*M[14] - M[12]*M[6]*M[11] + M[12]*M[7]*M[10];
+  A[ 8] =  M[4]*M[ 9]*M[15] - M[4]*M[11]*M[13] - M[8]*M[5]*M[15]
+    + M[8]*M[7]*M[13] + M[12]*M[5]*M[11] - M[12]*M[7]*M[ 9];
+  A[12] = -M[4]*M[ 9]*M[14] + M[4]*M[10]*M[13] + M[8]*M[5]*M[14]
+    - M[8]*M[6]*M[13] - M[12]*M[5]*M[10] + M[12]*M[6]*M[ 9];
+  A[ 1] = -M[1]*M[10]*M[15] + M[1]*M[11]*M[14] + M[9]*M[2]*M[15]
+    - M[9]*M[3]*M[14] - M[13]*M[2]*M[11] + M[13]*M[3]*M[10];
+  A[ 5] =  M[0]*M[10]*M[15] - M[0]*M[11]*M[14] - M[8]*M[2]*M[15]
+    + M[8]*M[3]*M[14] + M[12]*M[2]*M[11] - M[12]*M[3]*M[10];
+  A[ 9] = -M[0]*M[ 9]*M[15] + M[0]*M[11]*M[13] + M[8]*M[1]*M[15]
+    - M[8]*M[3]*M[13] - M[12]*M[1]*M[11] + M[12]*M[3]*M[ 9];
+  A[13] =  M[0]*M[ 9]*M[14] - M[0]*M[10]*M[13] - M[8]*M[1]*M[14]
+    + M[8]*M[2]*M[13] + M[12]*M[1]*M[10] - M[12]*M[2]*M[ 9];
+  A[ 2] =  M[1]*M[ 6]*M[15] - M[1]*M[ 7]*M[14] - M[5]*M[2]*M[15]
+    + M[5]*M[3]*M[14] + M[13]*M[2]*M[ 7] - M[13]*M[3]*M[ 6];
+  A[ 6] = -M[0]*M[ 6]*M[15] + M[0]*M[ 7]*M[14] + M[4]*M[2]*M[15]
+    - M[4]*M[3]*M[14] - M[12]*M[2]*M[ 7] + M[12]*M[3]*M[ 6];
+  A[10] =  M[0]*M[ 5]*M[15] - M[0]*M[ 7]*M[13] - M[4]*M[1]*M[15]
+    + M[4]*M[3]*M[13] + M[12]*M[1]*M[ 7] - M[12]*M[3]*M[ 5];
+  A[14] = -M[0]*M[ 5]*M[14] + M[0]*M[ 6]*M[13] + M[4]*M[1]*M[14]
+    - M[4]*M[2]*M[13] - M[12]*M[1]*M[ 6] + M[12]*M[2]*M[ 5];
+  A[ 3] = -M[1]*M[ 6]*M[11] + M[1]*M[ 7]*M[10] + M[5]*M[2]*M[11]
+    - M[5]*M[3]*M[10] - M[ 9]*M[2]*M[ 7] + M[ 9]*M[3]*M[ 6];
+  A[ 7] =  M[0]*M[ 6]*M[11] - M[0]*M[ 7]*M[10] - M[4]*M[2]*M[11]
+    + M[4]*M[3]*M[10] + M[ 8]*M[2]*M[ 7] - M[ 8]*M[3]*M[ 6];
+  A[11] = -M[0]*M[ 5]*M[11] + M[0]*M[ 7]*M[ 9] + M[4]*M[1]*M[11]
+    - M[4]*M[3]*M[ 9] - M[ 8]*M[1]*M[ 7] + M[ 8]*M[3]*M[ 5];
+  A[15] =  M[0]*M[ 5]*M[10] - M[0]*M[ 6]*M[ 9] - M[4]*M[1]*M[10]
+    + M[4]*M[2]*M[ 9] + M[ 8]*M[1]*M[ 6] - M[ 8]*M[2]*M[ 5];
+
+  const double det = M[0]*A[0] + M[1]*A[4] + M[2]*A[8] + M[3]*A[12];
+  if (det == 0.0) return false;
+  for (int k=0; k<16; ++k) Minv[k] = A[k] / det;
+  return true;
+}
@@ -0,0 +1,131 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * GLStateCache: a shadow of the OpenGL state which changes from one actor to
+ * the next, so that only the differences reach the driver.
+ *
+ * NOTES:
+ *
+ * The shadow is only correct as long as the state it covers is changed through
+ * it. Code which must set such state directly should restore it before
+ * returning, or else call reset(), which puts the state and the shadow back in
+ * agreement.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <algorithm>
+#include "luview.hpp"
+
+
+std::map<GLenum, bool> GLStateCache::enabled;
+std::vector<int> GLStateCache::forced;
+GLuint GLStateCache::program = 0;
+double GLStateCache::width = -1.0;
+double GLStateCache::alpha = -1.0;
+
+
+void GLStateCache::reset()
+// -----------------------------------------------------------------------------
+// Disables every capability enabled through the cache, returns to the fixed
+// function pipeline, and forgets the line width, material and any forced
+// capabilities.
+// -----------------------------------------------------------------------------
+{
+  forced.clear();
+  for (std::map<GLenum, bool>::iterator e=enabled.begin();
+       e!=enabled.end(); ++e) {
+    if (e->second) glDisable(e->first);
+    e->second = false;
+  }
+  glUseProgram(0);
+  program = 0;
+  width = -1.0;
+  alpha = -1.0;
+}
+void GLStateCache::set_modes(const std::vector<int> &modes)
+// -----------------------------------------------------------------------------
+// Enables exactly the capabilities in `modes`, out of all those which have been
+// enabled through the cache.
+// -----------------------------------------------------------------------------
+{
+  for (std::map<GLenum, bool>::iterator e=enabled.begin();
+       e!=enabled.end(); ++e) {
+    const int cap = e->first;
+    if (e->second &&
+        std::find(modes.begin(), modes.end(), cap) == modes.end() &&
+        std::find(forced.begin(), forced.end(), cap) == forced.end()) {
+      glDisable(e->first);
+      e->second = false;
+    }
+  }
+  for (unsigned int i=0; i<modes.size(); ++i) {
+    enable(modes[i]);
+  }
+}
+void GLStateCache::force(GLenum cap)
+// -----------------------------------------------------------------------------
+// Enables `cap` and keeps it enabled until the next reset.
+// -----------------------------------------------------------------------------
+{
+  forced.push_back(cap);
+  enable(cap);
+}
+void GLStateCache::enable(GLenum cap)
+{
+  bool &on = enabled[cap];
+  if (!on) {
+    glEnable(cap);
+    on = true;
+  }
+}
+void GLStateCache::disable(GLenum cap)
+{
+  std::map<GLenum, bool>::iterator e = enabled.find(cap);
+  if (e == enabled.end()) {
+    glDisable(cap);
+    enabled[cap] = false;
+  }
+  else if (e->second) {
+    glDisable(cap);
+    e->second = false;
+  }
+}
+void GLStateCache::use_program(GLuint prog)
+{
+  if (prog != program) {
+    glUseProgram(prog);
+    program = prog;
+  }
+}
+GLuint GLStateCache::get_program()
+{
+  return program;
+}
+void GLStateCache::line_width(double w)
+{
+  if (w != width) {
+    glLineWidth(w);
+    width = w;
+  }
+}
+void GLStateCache::material(double a)
+// -----------------------------------------------------------------------------
+// Sets the front material used by all actors, which varies only with alpha.
+// While GL_COLOR_MATERIAL is on, every glColor overwrites the diffuse material,
+// so it is then specified each time, and forgotten for the next actor.
+// -----------------------------------------------------------------------------
+{
+  std::map<GLenum, bool>::iterator e = enabled.find(GL_COLOR_MATERIAL);
+  const bool tracking = e != enabled.end() && e->second;
+  if (a != alpha || tracking) {
+    GLfloat mat_diff[] = { 0.9, 0.9, 0.9, GLfloat(a) };
+    GLfloat mat_spec[] = { 1.0, 1.0, 1.0, GLfloat(a) };
+    GLfloat mat_shin[] = { 128.0 };
+
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diff);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_spec);
+    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shin);
+    alpha = tracking ? -1.0 : a;
+  }
+}
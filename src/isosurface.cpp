@@ -0,0 +1,402 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * IsosurfaceSource: the surface on which a 3d scalar DataSource equals a given
+ * value, as a triangle mesh.
+ *
+ * NOTES:
+ *
+ * Each cell of the grid is split into six tetrahedra around its main diagonal,
+ * and each tetrahedron cut by the surface gives one or two triangles. All cells
+ * are split along the same diagonal, so that neighbors agree on the diagonals
+ * of the faces they share and the surface has no cracks.
+ *
+ * The grid is divided into blocks of 8^3 cells. The value range of each block
+ * is found once for every version of the input, and the ranges are merged by
+ * eights into a pyramid. When the iso value changes, the pyramid is descended
+ * only where the value lies within a range, and the blocks found are
+ * triangulated in parallel, so that the work is proportional to the size of
+ * the surface rather than that of the grid.
+ *
+ * Vertices are shared by the triangles of a block, and the normals are taken
+ * from the gradient of the field, pointing toward lower values. The scalar of
+ * each vertex is the magnitude of the gradient.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "luview.hpp"
+#include "bricks.hpp"
+
+#define __ISO_BLOCK 8 // number of cells along the side of a block
+
+// The six tetrahedra of a cell, as corners whose bits 0, 1 and 2 are offsets
+// along the last, middle and first axis of the grid.
+static const int Tetrahedra[6][4] = {
+  {0,1,3,7}, {0,3,2,7}, {0,2,6,7}, {0,6,4,7}, {0,4,5,7}, {0,5,1,7} };
+
+struct IsoBlock
+{
+  std::vector<GLfloat> verts;
+  std::vector<GLuint> indices;
+} ;
+
+struct IsoGrid
+{
+  const GLfloat *f;
+  int N[3];
+  double h[3]; // spacing along each axis, in the unit cube
+  double iso;
+} ;
+
+
+static void gradient(const IsoGrid &G, int i, int j, int k, double *g)
+// -----------------------------------------------------------------------------
+// Central differences of the field at a grid point, one sided at the faces.
+// -----------------------------------------------------------------------------
+{
+  const int p[3] = { i, j, k };
+  const int s[3] = { G.N[1]*G.N[2], G.N[2], 1 };
+  const GLfloat *f = G.f + (i*G.N[1] + j)*G.N[2] + k;
+
+  for (int d=0; d<3; ++d) {
+    const int lo = p[d] > 0 ? -1 : 0;
+    const int hi = p[d] < G.N[d] - 1 ? 1 : 0;
+    g[d] = hi == lo ? 0.0 : (f[hi*s[d]] - f[lo*s[d]]) / ((hi - lo) * G.h[d]);
+  }
+}
+
+static GLuint edge_vertex(const IsoGrid &G, const int *p, int mask,
+                          const int *origin, std::vector<int> &edge_ids,
+                          IsoBlock &out)
+// -----------------------------------------------------------------------------
+// Returns the index of the vertex on the edge from grid point p to the point
+// offset from it by `mask`, adding the vertex if the edge has not yet been
+// visited in this block.
+// -----------------------------------------------------------------------------
+{
+  const int B = __ISO_BLOCK + 1;
+  const int local = ((p[0] - origin[0])*B + (p[1] - origin[1]))*B +
+    (p[2] - origin[2]);
+  int &id = edge_ids[7*local + mask - 1];
+  if (id >= 0) return id;
+
+  const int q[3] = { p[0] + ((mask >> 2) & 1),
+                     p[1] + ((mask >> 1) & 1),
+                     p[2] + ((mask >> 0) & 1) };
+  const double fp = G.f[(p[0]*G.N[1] + p[1])*G.N[2] + p[2]];
+  const double fq = G.f[(q[0]*G.N[1] + q[1])*G.N[2] + q[2]];
+  const double t = fq == fp ? 0.5 : (G.iso - fp) / (fq - fp);
+
+  double gp[3], gq[3], n[3], x[3];
+  gradient(G, p[0], p[1], p[2], gp);
+  gradient(G, q[0], q[1], q[2], gq);
+  for (int d=0; d<3; ++d) {
+    x[d] = (p[d] + t*(q[d] - p[d]) + 0.5) * G.h[d] - 0.5;
+    n[d] = -(gp[d] + t*(gq[d] - gp[d]));
+  }
+  const double norm = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+  const double inv = norm > 0.0 ? 1.0 / norm : 0.0;
+
+  // x, y, z are the last, middle and first axis
+  const GLfloat v[__MESH_STRIDE] = { GLfloat(x[2]), GLfloat(x[1]),
+                                     GLfloat(x[0]), GLfloat(n[2]*inv),
+                                     GLfloat(n[1]*inv), GLfloat(n[0]*inv),
+                                     GLfloat(norm) };
+  id = out.verts.size() / __MESH_STRIDE;
+  out.verts.insert(out.verts.end(), v, v + __MESH_STRIDE);
+  return id;
+}
+
+static void emit_triangle(IsoBlock &out, GLuint a, GLuint b, GLuint c)
+// -----------------------------------------------------------------------------
+// Adds the triangle wound counter-clockwise about the vertex normals.
+// -----------------------------------------------------------------------------
+{
+  const GLfloat *A = &out.verts[__MESH_STRIDE*a];
+  const GLfloat *B = &out.verts[__MESH_STRIDE*b];
+  const GLfloat *C = &out.verts[__MESH_STRIDE*c];
+  const double u[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+  const double v[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+  const double n[3] = { u[1]*v[2] - u[2]*v[1],
+                        u[2]*v[0] - u[0]*v[2],
+                        u[0]*v[1] - u[1]*v[0] };
+  double dot = 0.0;
+  for (int d=0; d<3; ++d) dot += n[d] * (A[3 + d] + B[3 + d] + C[3 + d]);
+
+  out.indices.push_back(a);
+  out.indices.push_back(dot < 0.0 ? c : b);
+  out.indices.push_back(dot < 0.0 ? b : c);
+}
+
+static void polygonize_block(const IsoGrid &G, const int *block,
+                             std::vector<int> &edge_ids, IsoBlock &out)
+{
+  const int B = __ISO_BLOCK;
+  const int origin[3] = { block[0]*B, block[1]*B, block[2]*B };
+  const int end[3] = { std::min(origin[0] + B, G.N[0] - 1),
+                       std::min(origin[1] + B, G.N[1] - 1),
+                       std::min(origin[2] + B, G.N[2] - 1) };
+
+  out.verts.clear();
+  out.indices.clear();
+  edge_ids.assign(7*(B + 1)*(B + 1)*(B + 1), -1);
+
+  for (int i=origin[0]; i<end[0]; ++i) {
+    for (int j=origin[1]; j<end[1]; ++j) {
+      for (int k=origin[2]; k<end[2]; ++k) {
+        int corner[8][3];
+        bool above[8];
+        int num_above = 0;
+        for (int c=0; c<8; ++c) {
+          corner[c][0] = i + ((c >> 2) & 1);
+          corner[c][1] = j + ((c >> 1) & 1);
+          corner[c][2] = k + ((c >> 0) & 1);
+          above[c] = G.f[(corner[c][0]*G.N[1] + corner[c][1])*G.N[2] +
+                         corner[c][2]] > G.iso;
+          num_above += above[c];
+        }
+        if (num_above == 0 || num_above == 8) continue;
+
+        for (int t=0; t<6; ++t) {
+          const int *tet = Tetrahedra[t];
+          int in[4], out_[4], nin = 0, nout = 0;
+          for (int c=0; c<4; ++c) {
+            if (above[tet[c]]) in[nin++] = tet[c];
+            else out_[nout++] = tet[c];
+          }
+          if (nin == 0 || nout == 0) continue;
+
+          // The corners of a tetrahedron are ordered by inclusion of their
+          // bits, so the lower end of each edge is the one with fewer bits.
+          GLuint e[4];
+          int ne = 0;
+          const int *lone = nin == 1 ? in : out_;
+          const int *rest = nin == 1 ? out_ : in;
+          if (nin == 1 || nout == 1) {
+            for (int r=0; r<3; ++r) {
+              const int a = std::min(lone[0], rest[r]);
+              const int b = std::max(lone[0], rest[r]);
+              e[ne++] = edge_vertex(G, corner[a], a ^ b, origin, edge_ids, out);
+            }
+            emit_triangle(out, e[0], e[1], e[2]);
+          }
+          else {
+            // The quad in[0]-out[0], in[0]-out[1], in[1]-out[1], in[1]-out[0]
+            const int pairs[4][2] = { {in[0], out_[0]}, {in[0], out_[1]},
+                                      {in[1], out_[1]}, {in[1], out_[0]} };
+            for (int r=0; r<4; ++r) {
+              const int a = std::min(pairs[r][0], pairs[r][1]);
+              const int b = std::max(pairs[r][0], pairs[r][1]);
+              e[ne++] = edge_vertex(G, corner[a], a ^ b, origin, edge_ids, out);
+            }
+            emit_triangle(out, e[0], e[1], e[2]);
+            emit_triangle(out, e[0], e[2], e[3]);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+IsosurfaceSource::IsosurfaceSource()
+  : __iso_value(0.5),
+    __pyramid_version(-1),
+    __num_active(0)
+{
+  __grid_shape[0] = __grid_shape[1] = __grid_shape[2] = 0;
+}
+void IsosurfaceSource::__init_lua_objects()
+{
+  const char *names[] = { "triangles", "normals", "scalars" };
+  const int columns[] = { 0, 3, 6 };
+  const int widths[] = { 3, 3, 1 };
+  MeshSource *mesh = create<MeshSource>(__lua_state);
+
+  hold(__output_ds["mesh"] = mesh);
+  mesh->set_input(this);
+
+  for (int n=0; n<3; ++n) {
+    MeshAttribute *attr = create<MeshAttribute>(__lua_state);
+    hold(__output_ds[names[n]] = attr);
+    attr->set_columns(columns[n], widths[n]);
+    attr->set_input(mesh);
+  }
+}
+void IsosurfaceSource::set_iso_value(double v)
+{
+  __iso_value = v;
+  __staged = true;
+}
+
+void IsosurfaceSource::__build_pyramid(const GLfloat *f, const int *N)
+// -----------------------------------------------------------------------------
+// Finds the value range of every block, including the points on its upper
+// faces, and then of every eight neighboring blocks up to a single root.
+// -----------------------------------------------------------------------------
+{
+  const int B = __ISO_BLOCK;
+  std::vector<int> shape(3);
+  for (int d=0; d<3; ++d) shape[d] = std::max((N[d] - 2) / B + 1, 1);
+
+  __level_shape.assign(1, shape);
+  __level_min.assign(1, std::vector<GLfloat>(shape[0]*shape[1]*shape[2]));
+  __level_max.assign(1, std::vector<GLfloat>(shape[0]*shape[1]*shape[2]));
+
+  brick_ranges(f, N, B, 0, &shape[0], &__level_min[0][0], &__level_max[0][0]);
+
+  while (shape[0] > 1 || shape[1] > 1 || shape[2] > 1) {
+    const std::vector<int> below = shape;
+    for (int d=0; d<3; ++d) shape[d] = (shape[d] + 1) / 2;
+
+    const int L = __level_shape.size();
+    const int Nl = shape[0]*shape[1]*shape[2];
+    __level_shape.push_back(shape);
+    __level_min.push_back(std::vector<GLfloat>(Nl, +1e30));
+    __level_max.push_back(std::vector<GLfloat>(Nl, -1e30));
+
+    for (int i=0; i<below[0]; ++i) {
+      for (int j=0; j<below[1]; ++j) {
+        for (int k=0; k<below[2]; ++k) {
+          const int m = (i*below[1] + j)*below[2] + k;
+          const int n = ((i/2)*shape[1] + j/2)*shape[2] + k/2;
+          __level_min[L][n] = std::min(__level_min[L][n], __level_min[L-1][m]);
+          __level_max[L][n] = std::max(__level_max[L][n], __level_max[L-1][m]);
+        }
+      }
+    }
+  }
+}
+
+void IsosurfaceSource::__find_blocks(int level, int a, int b, int c,
+                                     std::vector<int> &blocks)
+// -----------------------------------------------------------------------------
+// Appends the blocks under node (a,b,c) of `level` whose cells may be cut by
+// the surface, that is, which have values both above and not above it.
+// -----------------------------------------------------------------------------
+{
+  const std::vector<int> &shape = __level_shape[level];
+  if (a >= shape[0] || b >= shape[1] || c >= shape[2]) return;
+
+  const int n = (a*shape[1] + b)*shape[2] + c;
+  if (__level_max[level][n] <= __iso_value ||
+      __level_min[level][n] > __iso_value) return;
+
+  if (level == 0) {
+    blocks.push_back(a);
+    blocks.push_back(b);
+    blocks.push_back(c);
+    return;
+  }
+  for (int i=0; i<2; ++i) {
+    for (int j=0; j<2; ++j) {
+      for (int k=0; k<2; ++k) {
+        __find_blocks(level - 1, 2*a + i, 2*b + j, 2*c + k, blocks);
+      }
+    }
+  }
+}
+
+void IsosurfaceSource::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 3);
+
+  IsoGrid G;
+  bool resized = false;
+  for (int d=0; d<3; ++d) {
+    G.N[d] = __input_ds->get_num_points(d);
+    G.h[d] = 1.0 / G.N[d];
+    resized |= G.N[d] != __grid_shape[d];
+    if (G.N[d] < 2) {
+      luaL_error(__lua_state, "%s needs at least 2x2x2 points", tname.c_str());
+    }
+  }
+  G.f = __input_ds->get_data();
+  G.iso = __iso_value;
+
+  if (resized || __pyramid_version != __input_ds->get_version()) {
+    __build_pyramid(G.f, G.N);
+    for (int d=0; d<3; ++d) __grid_shape[d] = G.N[d];
+    __pyramid_version = __input_ds->get_version();
+  }
+
+  std::vector<int> blocks;
+  __find_blocks(__level_shape.size() - 1, 0, 0, 0, blocks);
+  const int Nb = blocks.size() / 3;
+  std::vector<IsoBlock> parts(Nb);
+  __num_active = Nb;
+
+#pragma omp parallel
+  {
+    std::vector<int> edge_ids;
+#pragma omp for schedule(dynamic)
+    for (int n=0; n<Nb; ++n) {
+      polygonize_block(G, &blocks[3*n], edge_ids, parts[n]);
+    }
+  }
+
+  // Concatenate the blocks, offsetting the indices of each by the number of
+  // vertices before it.
+  std::vector<int> vert_start(Nb + 1, 0), ind_start(Nb + 1, 0);
+  for (int n=0; n<Nb; ++n) {
+    vert_start[n + 1] = vert_start[n] + parts[n].verts.size() / __MESH_STRIDE;
+    ind_start[n + 1] = ind_start[n] + parts[n].indices.size();
+  }
+  const int Nv = vert_start[Nb];
+  const int Ni = ind_start[Nb];
+
+  // The outputs must never be empty, so a surface missing the grid entirely
+  // is given a single degenerate triangle.
+  std::vector<GLfloat> verts(__MESH_STRIDE*std::max(Nv, 1), 0.0);
+  std::vector<GLuint> indices(std::max(Ni, 3), 0);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int n=0; n<Nb; ++n) {
+    std::copy(parts[n].verts.begin(), parts[n].verts.end(),
+              verts.begin() + __MESH_STRIDE*vert_start[n]);
+    for (unsigned int m=0; m<parts[n].indices.size(); ++m) {
+      indices[ind_start[n] + m] = parts[n].indices[m] + vert_start[n];
+    }
+  }
+
+  int Nvert[] = { std::max(Nv, 1), __MESH_STRIDE };
+  __output_ds["mesh"]->set_data(&verts[0], Nvert, 2);
+  __output_ds["mesh"]->set_indices(&indices[0], indices.size());
+}
+
+
+IsosurfaceSource::LuaInstanceMethod
+IsosurfaceSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_iso_value"] = _get_iso_value_;
+  attr["set_iso_value"] = _set_iso_value_;
+  attr["get_num_active_blocks"] = _get_num_active_blocks_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int IsosurfaceSource::_get_iso_value_(lua_State *L)
+{
+  IsosurfaceSource *self = checkarg<IsosurfaceSource>(L, 1);
+  lua_pushnumber(L, self->__iso_value);
+  return 1;
+}
+int IsosurfaceSource::_set_iso_value_(lua_State *L)
+{
+  IsosurfaceSource *self = checkarg<IsosurfaceSource>(L, 1);
+  self->set_iso_value(luaL_checknumber(L, 2));
+  return 0;
+}
+int IsosurfaceSource::_get_num_active_blocks_(lua_State *L)
+{
+  IsosurfaceSource *self = checkarg<IsosurfaceSource>(L, 1);
+  lua_pushnumber(L, self->__num_active);
+  return 1;
+}
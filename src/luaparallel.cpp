@@ -0,0 +1,244 @@
+/* -----------------------------------------------------------------------------
+ *
+ * Parallel evaluation of LuaFunction callbacks. The function is serialized
+ * with lua_dump and loaded into a pool of private lua_States, each of which
+ * evaluates a contiguous chunk of the points given to call_batch.
+ *
+ * NOTES:
+ *
+ * Worker states only have the standard libraries. The function's upvalues are
+ * copied into them before every batch, so locals captured from the script
+ * (numbers, strings, tables of those, and C functions such as math.cos) are
+ * seen with their current values. Globals defined by the script are not
+ * visible to the workers, and nothing the function writes to its upvalues or
+ * globals finds its way back, so the function should be pure.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include "luview.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define __LUAPOOL_MAXDEPTH 8 // deepest nesting of tables copied to workers
+
+
+static int dump_writer(lua_State *L, const void *p, size_t sz, void *ud)
+{
+  static_cast<std::string*>(ud)->append(static_cast<const char*>(p), sz);
+  return 0;
+}
+
+static bool copy_value(lua_State *L, int pos, lua_State *W, int depth)
+// -----------------------------------------------------------------------------
+// Pushes onto W a copy of the value at `pos` in L. Returns false if the value
+// cannot be copied between states, in which case nothing is pushed.
+// -----------------------------------------------------------------------------
+{
+  pos = lua_absindex(L, pos);
+  switch (lua_type(L, pos)) {
+  case LUA_TNIL:
+    lua_pushnil(W);
+    return true;
+  case LUA_TBOOLEAN:
+    lua_pushboolean(W, lua_toboolean(L, pos));
+    return true;
+  case LUA_TNUMBER:
+    lua_pushnumber(W, lua_tonumber(L, pos));
+    return true;
+  case LUA_TSTRING:
+    {
+      size_t len;
+      const char *s = lua_tolstring(L, pos, &len);
+      lua_pushlstring(W, s, len);
+    }
+    return true;
+  case LUA_TFUNCTION:
+    // C functions without upvalues live in the shared library, so the same
+    // pointer is valid in any state.
+    if (!lua_iscfunction(L, pos)) return false;
+    if (lua_getupvalue(L, pos, 1) != NULL) {
+      lua_pop(L, 1);
+      return false;
+    }
+    lua_pushcfunction(W, lua_tocfunction(L, pos));
+    return true;
+  case LUA_TTABLE:
+    if (depth >= __LUAPOOL_MAXDEPTH) return false;
+    lua_newtable(W);
+    lua_pushnil(L);
+    while (lua_next(L, pos)) {
+      if (!copy_value(L, -2, W, depth + 1)) {
+        lua_pop(L, 2);
+        lua_pop(W, 1);
+        return false;
+      }
+      if (!copy_value(L, -1, W, depth + 1)) {
+        lua_pop(L, 2);
+        lua_pop(W, 2);
+        return false;
+      }
+      lua_rawset(W, -3);
+      lua_pop(L, 1);
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+LuaFunction::~LuaFunction()
+{
+  __close_workers();
+}
+
+void LuaFunction::set_parallel(int nstates)
+// -----------------------------------------------------------------------------
+// Creates a pool of `nstates` worker states, or one for each available thread
+// if `nstates` is negative. A value of zero returns to serial evaluation.
+// -----------------------------------------------------------------------------
+{
+  lua_State *L = __lua_state;
+  __close_workers();
+
+  if (nstates == 0) return;
+  if (nstates < 0) {
+#ifdef _OPENMP
+    nstates = omp_get_max_threads();
+#else
+    nstates = 1;
+#endif
+  }
+
+  std::string chunk;
+  retrieve("lua_callback");
+  if (lua_iscfunction(L, -1)) {
+    luaL_error(L, "only Lua functions may be evaluated in parallel");
+  }
+  lua_dump(L, dump_writer, &chunk);
+  lua_pop(L, 1);
+
+  for (int m=0; m<nstates; ++m) {
+    lua_State *W = luaL_newstate();
+    luaL_openlibs(W);
+    if (luaL_loadbuffer(W, chunk.c_str(), chunk.size(), "=transform") != 0) {
+      lua_close(W);
+      __close_workers();
+      luaL_error(L, "could not load function into worker state");
+    }
+    lua_setfield(W, LUA_REGISTRYINDEX, "luview_callback");
+    workers.push_back(W);
+  }
+}
+
+void LuaFunction::__close_workers()
+{
+  for (unsigned int m=0; m<workers.size(); ++m) {
+    lua_close(workers[m]);
+  }
+  workers.clear();
+}
+
+void LuaFunction::__sync_upvalues()
+// -----------------------------------------------------------------------------
+// Copies the current values of the function's upvalues into each worker. The
+// _ENV upvalue is bound to the worker's own globals.
+// -----------------------------------------------------------------------------
+{
+  lua_State *L = __lua_state;
+  retrieve("lua_callback");
+
+  const char *name;
+  for (int i=1; (name = lua_getupvalue(L, -1, i)) != NULL; ++i) {
+    const bool env = strcmp(name, "_ENV") == 0;
+    for (unsigned int m=0; m<workers.size(); ++m) {
+      lua_State *W = workers[m];
+      lua_getfield(W, LUA_REGISTRYINDEX, "luview_callback");
+      if (env) {
+        lua_rawgeti(W, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+      }
+      else if (!copy_value(L, -1, W, 0)) {
+        lua_settop(W, 0);
+        luaL_error(L, "upvalue '%s' of type %s cannot be copied to the worker "
+                   "states", name, luaL_typename(L, -1));
+      }
+      lua_setupvalue(W, -2, i);
+      lua_pop(W, 1);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+}
+
+int LuaFunction::__call_parallel(const double *x, int narg, int N,
+                                 std::vector<double> &res)
+// -----------------------------------------------------------------------------
+// Splits the N points into one contiguous chunk per worker state. The first
+// point is evaluated up front to learn the number of values returned. Errors
+// raised in the workers are collected and reported once all have finished.
+// -----------------------------------------------------------------------------
+{
+  lua_State *L = __lua_state;
+  const int M = workers.size();
+  int nret = 0;
+
+  if (narg > __CALLBACK_MAXARGS) {
+    luaL_error(L, "at most %d arguments are supported", __CALLBACK_MAXARGS);
+  }
+  if (N == 0) {
+    res.clear();
+    return 0;
+  }
+  __sync_upvalues();
+
+  {
+    lua_State *W = workers[0];
+    lua_getfield(W, LUA_REGISTRYINDEX, "luview_callback");
+    for (int k=0; k<narg; ++k) lua_pushnumber(W, x[k*N]);
+    if (lua_pcall(W, narg, LUA_MULTRET, 0) != 0) {
+      std::string msg = lua_tostring(W, -1);
+      lua_settop(W, 0);
+      luaL_error(L, "%s", msg.c_str());
+    }
+    nret = lua_gettop(W);
+    lua_settop(W, 0);
+  }
+  res.resize(nret*N);
+  std::vector<std::string> errors(M);
+
+#pragma omp parallel for num_threads(M) schedule(static, 1)
+  for (int m=0; m<M; ++m) {
+    lua_State *W = workers[m];
+    const int n0 = (long) N * m / M;
+    const int n1 = (long) N * (m + 1) / M;
+
+    for (int n=n0; n<n1; ++n) {
+      lua_getfield(W, LUA_REGISTRYINDEX, "luview_callback");
+      for (int k=0; k<narg; ++k) lua_pushnumber(W, x[k*N + n]);
+      if (lua_pcall(W, narg, LUA_MULTRET, 0) != 0) {
+        errors[m] = lua_tostring(W, -1);
+        lua_settop(W, 0);
+        break;
+      }
+      if (lua_gettop(W) != nret) {
+        errors[m] = "function returned a varying number of values";
+        lua_settop(W, 0);
+        break;
+      }
+      for (int k=0; k<nret; ++k) res[k*N + n] = lua_tonumber(W, k + 1);
+      lua_settop(W, 0);
+    }
+  }
+
+  for (int m=0; m<M; ++m) {
+    if (!errors[m].empty()) {
+      luaL_error(L, "%s", errors[m].c_str());
+    }
+  }
+  return nret;
+}
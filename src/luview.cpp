@@ -18,6 +18,11 @@ extern "C" {
 }
 #include "glInfo.hpp"
 
+#ifdef __LUVIEW_USE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#define __LUVIEW_IDLE_INTERVAL (1.0/60) // seconds between idle callbacks
 
 
 GpuInformation::LuaInstanceMethod
@@ -64,48 +69,94 @@ int CallbackFunction::_call()
 {
   lua_State *L = __lua_state;
   int narg = lua_gettop(L);
-  std::vector<double> args;
-  for (int n=1; n<=narg; ++n) {
-    args.push_back(lua_tonumber(L, n));
+  double x[__CALLBACK_MAXARGS];
+  double res[__CALLBACK_MAXARGS];
+  if (narg > __CALLBACK_MAXARGS) {
+    luaL_error(L, "at most %d arguments are supported", __CALLBACK_MAXARGS);
+  }
+  for (int n=0; n<narg; ++n) {
+    x[n] = lua_tonumber(L, n+1);
   }
-  std::vector<double> res = call(args);
-  for (unsigned int n=0; n<res.size(); ++n) {
+  int nret = call(x, narg, res);
+  for (int n=0; n<nret; ++n) {
     lua_pushnumber(L, res[n]);
   }
-  return res.size();
+  return nret;
+}
+int CallbackFunction::call(const double *x, int narg, double *res)
+{
+  return call_priv(x, narg, res);
 }
 std::vector<double> CallbackFunction::call()
 {
-  return call_priv(NULL, 0);
+  return call(NULL, 0);
 }
 std::vector<double> CallbackFunction::call(double u)
 {
   double x[1] = {u};
-  return call_priv(x, 1);
+  return call(x, 1);
 }
 std::vector<double> CallbackFunction::call(double u, double v)
 {
   double x[2] = {u,v};
-  return call_priv(x, 2);
+  return call(x, 2);
 }
 std::vector<double> CallbackFunction::call(double u, double v, double w)
 {
   double x[3] = {u,v,w};
-  return call_priv(x, 3);
+  return call(x, 3);
+}
+std::vector<double> CallbackFunction::call(const std::vector<double> &X)
+{
+  return call(X.empty() ? NULL : &X[0], X.size());
+}
+std::vector<double> CallbackFunction::call(const double *x, int narg)
+{
+  double res[__CALLBACK_MAXARGS];
+  int nret = call_priv(x, narg, res);
+  return std::vector<double>(res, res + nret);
 }
-std::vector<double> CallbackFunction::call(std::vector<double> X)
+int CallbackFunction::call_batch(const double *x, int narg, int N,
+                                 std::vector<double> &res)
 {
-  return call_priv(&X[0], X.size());
+  return call_batch_priv(x, narg, N, res);
+}
+int CallbackFunction::call_batch_priv(const double *x, int narg, int N,
+                                      std::vector<double> &res)
+// -----------------------------------------------------------------------------
+// Fallback for functions which cannot be evaluated on whole columns: calls the
+// function once per point.
+// -----------------------------------------------------------------------------
+{
+  double X[__CALLBACK_MAXARGS];
+  double Y[__CALLBACK_MAXARGS];
+  int nret = 0;
+  if (narg > __CALLBACK_MAXARGS) {
+    luaL_error(__lua_state, "at most %d arguments are supported",
+               __CALLBACK_MAXARGS);
+  }
+  for (int n=0; n<N; ++n) {
+    for (int k=0; k<narg; ++k) X[k] = x[k*N + n];
+    const int m = call_priv(X, narg, Y);
+    if (n == 0) {
+      nret = m;
+      res.resize(nret*N);
+    }
+    else if (m != nret) {
+      luaL_error(__lua_state, "function returned %d values, expected %d",
+                 m, nret);
+    }
+    for (int k=0; k<nret; ++k) res[k*N + n] = Y[k];
+  }
+  return nret;
 }
 
-std::vector<double> LuaFunction::call_priv(double *x, int narg)
+int LuaFunction::call_priv(const double *x, int narg, double *res)
 {
   lua_State *L = __lua_state;
-  std::vector<double> res;
   int nstart = lua_gettop(L);
   retrieve("lua_callback");
 
-
   for (int i=0; i<narg; ++i) {
     lua_pushnumber(L, x[i]);
   }
@@ -113,12 +164,62 @@ std::vector<double> LuaFunction::call_priv(double *x, int narg)
     luaL_error(L, lua_tostring(L, -1));
   }
   int nret = lua_gettop(L) - nstart;
+  if (nret > __CALLBACK_MAXARGS) {
+    luaL_error(L, "function returned %d values, at most %d are supported",
+               nret, __CALLBACK_MAXARGS);
+  }
   for (int i=0; i<nret; ++i) {
-    res.push_back(lua_tonumber(L, -1));
-    lua_pop(L, 1);
+    res[i] = lua_tonumber(L, nstart + 1 + i);
   }
-  reverse(res.begin(), res.end());
-  return res;
+  lua_settop(L, nstart);
+  return nret;
+}
+int LuaFunction::call_batch_priv(const double *x, int narg, int N,
+                                 std::vector<double> &res)
+// -----------------------------------------------------------------------------
+// Calls the Lua function once, passing each argument column as a lunum array of
+// length N. It must return arrays of length N, or numbers which are taken to
+// be constant over the batch.
+// -----------------------------------------------------------------------------
+{
+  if (!workers.empty()) {
+    return __call_parallel(x, narg, N, res);
+  }
+  if (!batched) {
+    return CallbackFunction::call_batch_priv(x, narg, N, res);
+  }
+  lua_State *L = __lua_state;
+  int nstart = lua_gettop(L);
+  retrieve("lua_callback");
+
+  for (int i=0; i<narg; ++i) {
+    lunum_pusharray2(L, (void*)&x[i*N], ARRAY_TYPE_DOUBLE, N);
+  }
+  if (lua_pcall(L, narg, LUA_MULTRET, 0) != 0) {
+    luaL_error(L, lua_tostring(L, -1));
+  }
+  int nret = lua_gettop(L) - nstart;
+  res.resize(nret*N);
+
+  for (int k=0; k<nret; ++k) {
+    const int pos = nstart + 1 + k;
+    if (lua_type(L, pos) == LUA_TNUMBER) {
+      const double y = lua_tonumber(L, pos);
+      for (int n=0; n<N; ++n) res[k*N + n] = y;
+    }
+    else {
+      int Ny;
+      const double *y = (double*) lunum_checkarray2(L, pos, ARRAY_TYPE_DOUBLE,
+                                                    &Ny);
+      if (Ny != N) {
+        luaL_error(L, "batched function returned an array of length %d, "
+                   "expected %d", Ny, N);
+      }
+      std::copy(y, y + N, &res[k*N]);
+    }
+  }
+  lua_settop(L, nstart);
+  return nret;
 }
 
 
@@ -142,6 +243,23 @@ LuviewTraitedObject::LuviewTraitedObject()
 
   Alpha = 1.0;
   LineWidth = 1.0;
+  Revision = 0;
+}
+void LuviewTraitedObject::get_state(std::vector<double> &state)
+// -----------------------------------------------------------------------------
+// Appends numbers which change whenever anything the object is drawn from
+// does: its revision, the version of each of its DataSources, which are
+// compiled first, and the version of each of its callbacks.
+// -----------------------------------------------------------------------------
+{
+  state.push_back(Revision);
+  for (EntryDS ds=DataSources.begin(); ds!=DataSources.end(); ++ds) {
+    ds->second->compile();
+    state.push_back(ds->second->get_version());
+  }
+  for (EntryCB cb=Callbacks.begin(); cb!=Callbacks.end(); ++cb) {
+    state.push_back(cb->second->get_version());
+  }
 }
 LuviewTraitedObject::LuaInstanceMethod LuviewTraitedObject::__getattr__
 (std::string &method_name)
@@ -185,6 +303,7 @@ int LuviewTraitedObject::_set_Callback_(lua_State *L)
   const char *name = luaL_checkstring(L, 2);
   CallbackFunction *newcb = CallbackFunction::create_from_stack(L, 3);
   const char *help = luaL_optstring(L, 4, "");
+  ++self->Revision;
   self->Callbacks[name] = self->replace(self->Callbacks[name], newcb);
   if (self->Callbacks[name] == NULL) {
     self->Callbacks.erase(self->Callbacks.find(name));
@@ -211,6 +330,7 @@ int LuviewTraitedObject::_set_DataSource_(lua_State *L)
 {
   LuviewTraitedObject *self = checkarg<LuviewTraitedObject>(L, 1);
   const char *name = luaL_checkstring(L, 2);
+  ++self->Revision;
   self->DataSources[name] = self->replace(self->DataSources[name], 3);
   if (self->DataSources[name] == NULL) {
     self->DataSources.erase(self->DataSources.find(name));
@@ -236,42 +356,115 @@ DrawableObject::DrawableObject() : shader(NULL)
 
 }
 void DrawableObject::draw()
+// -----------------------------------------------------------------------------
+// State is changed through GLStateCache, so that only what differs from the
+// previous actor reaches the driver. Any other state changed by draw_local
+// must be put back as it was found. The color is issued before the material,
+// which GLStateCache re-specifies whenever GL_COLOR_MATERIAL is on.
+// -----------------------------------------------------------------------------
 {
-  for (unsigned int i=0; i<gl_modes.size(); ++i) {
-    glEnable(gl_modes[i]);
-  }
+  GLStateCache::set_modes(gl_modes);
+  GLStateCache::use_program(shader ? shader->get_id() : 0);
   glPushMatrix();
-  glPushAttrib(GL_ALL_ATTRIB_BITS);
-  glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
-  if (shader) shader->activate();
 
-  glTranslated(Position[0], Position[1], Position[2]);
-  glScaled(Scale[0], Scale[1], Scale[2]);
-  glRotated(Orientation[0], 1, 0, 0);
-  glRotated(Orientation[1], 0, 1, 0);
-  glRotated(Orientation[2], 0, 0, 1);
+  double M[16];
+  get_transform(M);
+  glMultMatrixd(M);
 
   glColor4d(Color[0], Color[1], Color[2], Alpha);
-  glLineWidth(LineWidth);
-
-  GLfloat mat_diff[] = { 0.9, 0.9, 0.9, Alpha };
-  GLfloat mat_spec[] = { 1.0, 1.0, 1.0, Alpha };
-  GLfloat mat_shin[] = { 128.0 };
-
-  glMaterialfv(GL_FRONT, GL_DIFFUSE, mat_diff);
-  glMaterialfv(GL_FRONT, GL_SPECULAR, mat_spec);
-  glMaterialfv(GL_FRONT, GL_SHININESS, mat_shin);
+  GLStateCache::line_width(LineWidth);
+  GLStateCache::material(Alpha);
 
   draw_local();
-  if (shader) shader->deactivate();
-
-  glPopClientAttrib();
-  glPopAttrib();
   glPopMatrix();
-
-  for (unsigned int i=0; i<gl_modes.size(); ++i) {
-    glDisable(gl_modes[i]);
+}
+void DrawableObject::get_state(std::vector<double> &state)
+// -----------------------------------------------------------------------------
+// Also lists the version of the shader, so that replacing its program redraws
+// every actor using it.
+// -----------------------------------------------------------------------------
+{
+  LuviewTraitedObject::get_state(state);
+  state.push_back(shader ? shader->get_version() : -1);
+}
+bool DrawableObject::sorts_before(DrawableObject *other)
+// -----------------------------------------------------------------------------
+// Orders actors by program, then color table, then enabled capabilities, so
+// that neighbors in a sorted queue share as much state as possible.
+// -----------------------------------------------------------------------------
+{
+  const GLuint p0 = shader ? shader->get_id() : 0;
+  const GLuint p1 = other->shader ? other->shader->get_id() : 0;
+  if (p0 != p1) return p0 < p1;
+
+  EntryDS t0 = DataSources.find("color_table");
+  EntryDS t1 = other->DataSources.find("color_table");
+  const GLuint x0 = t0 == DataSources.end() ? 0 : t0->second->get_texture_id();
+  const GLuint x1 = t1 == other->DataSources.end() ? 0 :
+    t1->second->get_texture_id();
+  if (x0 != x1) return x0 < x1;
+
+  return gl_modes < other->gl_modes;
+}
+void DrawableObject::get_transform(double *M)
+// -----------------------------------------------------------------------------
+// The matrix taking the object's own coordinates to those of the scene.
+// -----------------------------------------------------------------------------
+{
+  ViewFrustum::identity(M);
+  ViewFrustum::translate(M, Position[0], Position[1], Position[2]);
+  ViewFrustum::scale(M, Scale[0], Scale[1], Scale[2]);
+  ViewFrustum::rotate(M, Orientation[0], 0);
+  ViewFrustum::rotate(M, Orientation[1], 1);
+  ViewFrustum::rotate(M, Orientation[2], 2);
+}
+bool DrawableObject::get_bounds(double *lo, double *hi)
+// -----------------------------------------------------------------------------
+// Finds the bounds, in the object's own coordinates, of the positions it is
+// drawn from. Returns false if they are not known, in which case the object is
+// never culled. Artists drawing from other data should override this.
+// -----------------------------------------------------------------------------
+{
+  const char *names[] = { "mesh", "triangles", "segments", "points" };
+  bool found = false;
+
+  for (int n=0; n<4; ++n) {
+    EntryDS ds = DataSources.find(names[n]);
+    double l[3], h[3];
+    if (ds == DataSources.end()) continue;
+    ds->second->compile();
+    if (!ds->second->get_bounds(l, h)) return false;
+    for (int d=0; d<3; ++d) {
+      if (!found || l[d] < lo[d]) lo[d] = l[d];
+      if (!found || h[d] > hi[d]) hi[d] = h[d];
+    }
+    found = true;
   }
+  return found;
+}
+bool DrawableObject::is_visible(const double *P, const double *V, int width,
+                                int height)
+// -----------------------------------------------------------------------------
+// Tests the object's bounds against the frustum of the projection P and the
+// camera's modelview V, in a viewport of the given size. The frustum is widened
+// by the margin in pixels that the object draws beyond its bounds.
+// -----------------------------------------------------------------------------
+{
+  double lo[3], hi[3], M[16], VM[16], PVM[16], S[16], SPVM[16];
+  if (!get_bounds(lo, hi)) return true;
+  get_transform(M);
+  ViewFrustum::multiply(V, M, VM);
+  ViewFrustum::multiply(P, VM, PVM);
+
+  const double margin = get_pixel_margin();
+  if (margin <= 0.0) {
+    return ViewFrustum(PVM).intersects(lo, hi);
+  }
+  ViewFrustum::identity(S);
+  ViewFrustum::scale(S, width / (width + 2*margin),
+                     height / (height + 2*margin), 1.0);
+  ViewFrustum::multiply(S, PVM, SPVM);
+  return ViewFrustum(SPVM).intersects(lo, hi);
 }
 
 
@@ -293,11 +486,40 @@ int DrawableObject::_get_shader_(lua_State *L)
 int DrawableObject::_set_shader_(lua_State *L)
 {
   DrawableObject *self = checkarg<DrawableObject>(L, 1);
+  ++self->Revision;
   self->shader = self->replace(self->shader, 2);
   return 0;
 }
 
 
+static bool draws_before(DrawableObject *a, DrawableObject *b)
+{
+  return a->sorts_before(b);
+}
+
+static const char *RenderModes[] = { "blend", "oit", NULL };
+enum { RENDER_BLEND, RENDER_OIT };
+
+static const char *OitCompositeVert = "\
+void main()\n\
+{\n\
+  gl_TexCoord[0] = gl_MultiTexCoord0;\n\
+  gl_Position = gl_Vertex;\n\
+}\n";
+
+static const char *OitCompositeFrag = "\
+uniform sampler2D opaque;\n\
+uniform sampler2D accum;\n\
+uniform sampler2D reveal;\n\
+void main()\n\
+{\n\
+  vec2 st = gl_TexCoord[0].st;\n\
+  vec4 a = texture2D(accum, st);\n\
+  float r = texture2D(reveal, st).r;\n\
+  vec3 c = a.rgb / max(a.a, 1e-5);\n\
+  gl_FragColor = vec4(mix(c, texture2D(opaque, st).rgb, r), 1.0);\n\
+}\n";
+
 class Window : public LuviewTraitedObject
 {
 private:
@@ -305,23 +527,66 @@ private:
   int character_input;
   static Window *CurrentWindow;
   bool first_frame;
+  bool culling;
+  int num_culled;
+  int render_mode;
+  FrameBuffer *oit_opaque, *oit_accum, *oit_reveal;
+  ShaderProgram *oit_composite;
+  bool on_demand; // if true, frames are only drawn when the scene changes
+  bool dirty; // input or window events since the last frame
+  std::vector<DrawableObject*> drawn_actors; // those of the last frame drawn
+  std::vector<double> drawn_state; // and the scene state they were drawn from
+#ifdef __LUVIEW_USE_OSMESA
+  OSMesaContext osmesa_context;
+  std::vector<GLubyte> osmesa_buffer; // RGBA pixels the context draws into
+#endif
 
 public:
   Window() : WindowWidth(1200),
-             WindowHeight(800), character_input(0), first_frame(true)
+             WindowHeight(800), character_input(0), first_frame(true),
+             culling(true), num_culled(0), render_mode(RENDER_BLEND),
+             oit_opaque(NULL), oit_accum(NULL), oit_reveal(NULL),
+             oit_composite(NULL), on_demand(false), dirty(true)
   {
     Orientation[0] = 9.0;
     Position[2] = -2.0;
-    this->start_window();
+#ifdef __LUVIEW_USE_OSMESA
+    osmesa_context = NULL;
+#endif
+  }
+  virtual ~Window()
+  {
+    delete oit_reveal;
+    delete oit_accum;
+    delete oit_opaque;
+#ifdef __LUVIEW_USE_OSMESA
+    if (osmesa_context) OSMesaDestroyContext(osmesa_context);
+#endif
   }
-  virtual ~Window() { }
 
 private:
+  void __init_lua_objects()
+  {
+    this->start_window();
+  }
   void start_window()
+  // ---------------------------------------------------------------------------
+  // Opens the window and its context. Built with __LUVIEW_USE_OSMESA, there is
+  // no window: frames are drawn by Mesa's software renderer into a buffer in
+  // memory, so that scripts may render and print them with no display at all.
+  // ---------------------------------------------------------------------------
   {
+#ifdef __LUVIEW_USE_OSMESA
+    osmesa_context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+    if (osmesa_context == NULL) {
+      luaL_error(__lua_state, "could not create an OSMesa context");
+    }
+    resize_offscreen(WindowWidth, WindowHeight);
+#else
     glfwInit();
     glfwOpenWindow(WindowWidth, WindowHeight, 5, 6, 5, 0, 8, 0, GLFW_WINDOW);
     glfwSetWindowTitle("Mythos science visualizer");
+#endif
 
     glClearDepth(1.0);
     glDepthFunc(GL_LESS);
@@ -334,12 +599,26 @@ private:
     gluPerspective(45.0, (float)WindowWidth/WindowHeight, 0.01, 200.0);
     glMatrixMode(GL_MODELVIEW);
 
+#ifndef __LUVIEW_USE_OSMESA
     glfwSetWindowSizeCallback(Reshape);
+    glfwSetWindowRefreshCallback(Refresh);
     glfwSetKeyCallback(KeyboardInput);
     glfwSetCharCallback(CharacterInput);
     glfwEnable(GLFW_STICKY_KEYS);
     glfwEnable(GLFW_KEY_REPEAT);
+#endif
   }
+#ifdef __LUVIEW_USE_OSMESA
+  void resize_offscreen(int width, int height)
+  {
+    osmesa_buffer.resize(4*width*height);
+    if (!OSMesaMakeCurrent(osmesa_context, &osmesa_buffer[0],
+                           GL_UNSIGNED_BYTE, width, height)) {
+      luaL_error(__lua_state, "could not make the OSMesa context current");
+    }
+    Reshape(width, height);
+  }
+#endif
 
   const char *render_scene(std::vector<DrawableObject*> &actors)
   {
@@ -357,6 +636,17 @@ private:
     character_input = ' ';
     CurrentWindow = this;
 
+    if (on_demand) {
+      std::vector<double> state;
+      get_scene_state(actors, state);
+      if (!dirty && actors == drawn_actors && state == drawn_state) {
+        return skip_frame();
+      }
+      drawn_actors = actors;
+      drawn_state = state;
+      dirty = false;
+    }
+
     glClearColor(Color[0], Color[1], Color[2], 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glLoadIdentity();
@@ -371,17 +661,51 @@ private:
     glLightfv(GL_LIGHT0, GL_SPECULAR, light_specular);
     glLightfv(GL_LIGHT0, GL_POSITION, light_position);
 
-    glTranslated(Position[0], Position[1], Position[2]);
-    glRotated(Orientation[0], 1, 0, 0);
-    glRotated(Orientation[1], 0, 1, 0);
-    glScaled(Scale[0], Scale[1], Scale[2]);
-
+    double P[16], V[16];
+    ViewFrustum::identity(V);
+    ViewFrustum::translate(V, Position[0], Position[1], Position[2]);
+    ViewFrustum::rotate(V, Orientation[0], 0);
+    ViewFrustum::rotate(V, Orientation[1], 1);
+    ViewFrustum::scale(V, Scale[0], Scale[1], Scale[2]);
+    glMultMatrixd(V);
+    glGetDoublev(GL_PROJECTION_MATRIX, P);
+    num_culled = 0;
+
+    // Opaque actors are drawn first, sorted so as to change as little state
+    // as possible between them. Translucent ones follow in the given order.
+    std::vector<DrawableObject*> opaque, translucent;
     for (std::vector<DrawableObject*>::iterator a=actors.begin();
          a!=actors.end(); ++a) {
       DrawableObject *actor = *a;
-      actor->draw();
+      if (culling && !actor->is_visible(P, V, WindowWidth, WindowHeight)) {
+        ++num_culled;
+      }
+      else if (actor->is_translucent()) {
+        translucent.push_back(actor);
+      }
+      else {
+        opaque.push_back(actor);
+      }
+    }
+    std::stable_sort(opaque.begin(), opaque.end(), draws_before);
+
+    GLStateCache::reset();
+    if (render_mode == RENDER_OIT && !translucent.empty()) {
+      draw_oit(opaque, translucent);
+    }
+    else {
+      for (unsigned int n=0; n<opaque.size(); ++n) {
+        opaque[n]->draw();
+      }
+      for (unsigned int n=0; n<translucent.size(); ++n) {
+        translucent[n]->draw();
+      }
     }
+    GLStateCache::reset();
 
+#ifdef __LUVIEW_USE_OSMESA
+    glFinish();
+#else
     glFlush();
     glfwSwapBuffers();
 
@@ -389,12 +713,140 @@ private:
       glfwCloseWindow();
       return "terminate";
     }
+#endif
 
     CurrentWindow->exec_callback("idle");
     return "continue";
   }
 
 private:
+  void get_scene_state(std::vector<DrawableObject*> &actors,
+                       std::vector<double> &state)
+  // ---------------------------------------------------------------------------
+  // Lists the camera, and the revision and data versions of each actor, which
+  // along with the actors themselves is all a frame is drawn from. Two frames
+  // with the same state would be the same image.
+  // ---------------------------------------------------------------------------
+  {
+    state.assign(Position, Position + 3);
+    state.insert(state.end(), Orientation, Orientation + 3);
+    state.insert(state.end(), Scale, Scale + 3);
+    state.insert(state.end(), Color, Color + 3);
+    state.push_back(Revision);
+    for (unsigned int n=0; n<actors.size(); ++n) {
+      actors[n]->get_state(state);
+    }
+  }
+  const char *skip_frame()
+  // ---------------------------------------------------------------------------
+  // Sleeps until there is input rather than drawing an unchanged scene again.
+  // An idle callback may change the scene without any input, so it is instead
+  // called once per frame interval, sleeping between polls for events.
+  // ---------------------------------------------------------------------------
+  {
+#ifndef __LUVIEW_USE_OSMESA
+    if (Callbacks.find("idle") == Callbacks.end()) {
+      glfwWaitEvents();
+    }
+    else {
+      glfwSleep(__LUVIEW_IDLE_INTERVAL);
+      glfwPollEvents();
+    }
+    if (glfwGetKey(GLFW_KEY_ESC) || !glfwGetWindowParam(GLFW_OPENED)) {
+      glfwCloseWindow();
+      return "terminate";
+    }
+#endif
+    exec_callback("idle");
+    return "continue";
+  }
+  void draw_oit(std::vector<DrawableObject*> &opaque,
+                std::vector<DrawableObject*> &translucent)
+  // ---------------------------------------------------------------------------
+  // Weighted blended order independent transparency. The opaque actors are
+  // drawn offscreen first. The translucent ones are then drawn twice against
+  // that depth, without writing to it: once summing color times alpha, and
+  // alpha, into a half float target, and once multiplying a revealage target
+  // by one minus alpha. The two are resolved over the opaque image as the
+  // alpha weighted average color, covering the fraction of the background
+  // which is not revealed. Every fragment has the same weight, since a depth
+  // weight would need to be written by each artist's own fragment shader.
+  // ---------------------------------------------------------------------------
+  {
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+
+    if (oit_opaque == NULL) {
+      oit_opaque = new FrameBuffer(false);
+      oit_accum = new FrameBuffer(true, oit_opaque);
+      oit_reveal = new FrameBuffer(true, oit_opaque);
+      hold(oit_composite = create<ShaderProgram>(__lua_state));
+      oit_composite->set_program(OitCompositeVert, OitCompositeFrag);
+    }
+    if (!oit_opaque->resize(vp[2], vp[3]) ||
+        !oit_accum->resize(vp[2], vp[3]) ||
+        !oit_reveal->resize(vp[2], vp[3])) {
+      render_mode = RENDER_BLEND;
+      luaL_error(__lua_state, "order independent transparency is not "
+                 "supported by this OpenGL driver");
+    }
+
+    oit_opaque->bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    for (unsigned int n=0; n<opaque.size(); ++n) {
+      opaque[n]->draw();
+    }
+    GLStateCache::reset();
+    GLStateCache::force(GL_BLEND);
+    glDepthMask(GL_FALSE);
+
+    oit_accum->bind();
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+    for (unsigned int n=0; n<translucent.size(); ++n) {
+      translucent[n]->draw();
+    }
+
+    oit_reveal->bind();
+    glClearColor(1.0, 1.0, 1.0, 1.0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    for (unsigned int n=0; n<translucent.size(); ++n) {
+      translucent[n]->draw();
+    }
+
+    FrameBuffer::unbind();
+    GLStateCache::reset();
+    glDepthMask(GL_TRUE);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glClearColor(Color[0], Color[1], Color[2], 1.0);
+
+    const GLuint textures[3] = { oit_opaque->get_texture(),
+                                 oit_accum->get_texture(),
+                                 oit_reveal->get_texture() };
+    for (int k=0; k<3; ++k) {
+      glActiveTexture(GL_TEXTURE0 + k);
+      glBindTexture(GL_TEXTURE_2D, textures[k]);
+    }
+    oit_composite->set_uniform("opaque", 0);
+    oit_composite->set_uniform("accum", 1);
+    oit_composite->set_uniform("reveal", 2);
+    GLStateCache::use_program(oit_composite->get_id());
+
+    glBegin(GL_QUADS);
+    glTexCoord2f(0, 0); glVertex2f(-1, -1);
+    glTexCoord2f(1, 0); glVertex2f(+1, -1);
+    glTexCoord2f(1, 1); glVertex2f(+1, +1);
+    glTexCoord2f(0, 1); glVertex2f(-1, +1);
+    glEnd();
+
+    for (int k=2; k>=0; --k) {
+      glActiveTexture(GL_TEXTURE0 + k);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+  }
+
   void TakeScreenshot(const char *basenm)
   {
     static int nframe = 0;
@@ -428,7 +880,8 @@ private:
   {
     EntryCB cb = Callbacks.find(key);
     if (cb != Callbacks.end()) {
-      cb->second->call();
+      double res[__CALLBACK_MAXARGS];
+      cb->second->call(NULL, 0, res);
       return 1;
     }
     else {
@@ -438,6 +891,7 @@ private:
   static void KeyboardInput(int key, int state)
   {
     if (state != GLFW_PRESS) return;
+    CurrentWindow->dirty = true;
     double *Orientation = CurrentWindow->Orientation;
     switch (key) {
     case GLFW_KEY_RIGHT : Orientation[1] += 3; break;
@@ -451,6 +905,7 @@ private:
   {
     double *Position = CurrentWindow->Position;
     double *Scale = CurrentWindow->Scale;
+    CurrentWindow->dirty = true;
 
     if (CurrentWindow->exec_callback((const char*)&key)) return;
 
@@ -475,10 +930,20 @@ private:
   }
   static void Reshape(int newWidth, int newHeight)
   {
+    glViewport(0, 0, newWidth, newHeight);
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluPerspective(45.0, (float)newWidth/newHeight, 0.01, 200.0);
     glMatrixMode(GL_MODELVIEW);
+    if (CurrentWindow) {
+      CurrentWindow->WindowWidth = newWidth;
+      CurrentWindow->WindowHeight = newHeight;
+      CurrentWindow->dirty = true;
+    }
+  }
+  static void Refresh()
+  {
+    if (CurrentWindow) CurrentWindow->dirty = true;
   }
 
 protected:
@@ -487,6 +952,14 @@ protected:
     AttributeMap attr;
     attr["render_scene"] = _render_scene_;
     attr["print_screen"] = _print_screen_;
+    attr["get_num_culled"] = _get_num_culled_;
+    attr["set_culling"] = _set_culling_;
+    attr["get_render_mode"] = _get_render_mode_;
+    attr["set_render_mode"] = _set_render_mode_;
+    attr["get_on_demand"] = _get_on_demand_;
+    attr["set_on_demand"] = _set_on_demand_;
+    attr["get_size"] = _get_size_;
+    attr["set_size"] = _set_size_;
     RETURN_ATTR_OR_CALL_SUPER(LuviewTraitedObject);
   }
   static int _render_scene_(lua_State *L)
@@ -512,6 +985,74 @@ protected:
     self->TakeScreenshot(basenm);
     return 0;
   }
+  static int _get_num_culled_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    lua_pushnumber(L, self->num_culled);
+    return 1;
+  }
+  static int _set_culling_(lua_State *L)
+  // ---------------------------------------------------------------------------
+  // Culling is on by default: actors whose bounds lie outside the view are not
+  // drawn. The bounds come from the positions an actor is drawn from, so an
+  // actor whose shader displaces its vertices may be culled while still in
+  // view. In that case call set_culling(false).
+  // ---------------------------------------------------------------------------
+  {
+    Window *self = checkarg<Window>(L, 1);
+    self->culling = lua_toboolean(L, 2);
+    ++self->Revision;
+    return 0;
+  }
+  static int _get_render_mode_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    lua_pushstring(L, RenderModes[self->render_mode]);
+    return 1;
+  }
+  static int _set_render_mode_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    self->render_mode = luaL_checkoption(L, 2, NULL, RenderModes);
+    ++self->Revision;
+    return 0;
+  }
+  static int _get_on_demand_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    lua_pushboolean(L, self->on_demand);
+    return 1;
+  }
+  static int _set_on_demand_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    self->on_demand = lua_toboolean(L, 2);
+    self->dirty = true;
+    return 0;
+  }
+  static int _get_size_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    lua_pushnumber(L, self->WindowWidth);
+    lua_pushnumber(L, self->WindowHeight);
+    return 2;
+  }
+  static int _set_size_(lua_State *L)
+  {
+    Window *self = checkarg<Window>(L, 1);
+    const int width = luaL_checkinteger(L, 2);
+    const int height = luaL_checkinteger(L, 3);
+    if (width < 1 || height < 1) {
+      luaL_error(L, "window size must be positive");
+    }
+    CurrentWindow = self;
+#ifdef __LUVIEW_USE_OSMESA
+    self->resize_offscreen(width, height);
+#else
+    glfwSetWindowSize(width, height);
+#endif
+    return 0;
+  }
 } ;
 Window *Window::CurrentWindow;
 
@@ -530,16 +1071,29 @@ extern "C" int luaopen_luview(lua_State *L)
 
   LuaCppObject::Register<DataSource>(L);
   LuaCppObject::Register<GridSource2D>(L);
+  LuaCppObject::Register<FunctionMapping>(L);
+  LuaCppObject::Register<PointsSource>(L);
+  LuaCppObject::Register<VolumeRayCaster>(L);
+  LuaCppObject::Register<StreamlineSource>(L);
+  LuaCppObject::Register<SliceSource>(L);
+  LuaCppObject::Register<ExpressionFunction>(L);
   LuaCppObject::Register<ParametricVertexSource3D>(L);
+  LuaCppObject::Register<IsosurfaceSource>(L);
+  LuaCppObject::Register<MeshDecimationSource>(L);
   LuaCppObject::Register<BoundingBox>(L);
   LuaCppObject::Register<ShaderProgram>(L);
   LuaCppObject::Register<ImagePlane>(L);
   LuaCppObject::Register<MatplotlibColormaps>(L);
 
   LuaCppObject::Register<Tesselation3D>(L);
+  LuaCppObject::Register<TimeSeriesSource>(L);
   LuaCppObject::Register<SegmentsEnsemble>(L);
   LuaCppObject::Register<ParametricSurface>(L);
   LuaCppObject::Register<TrianglesEnsemble>(L);
+  LuaCppObject::Register<PointsEnsemble>(L);
+  LuaCppObject::Register<TerrainSurface>(L);
+  LuaCppObject::Register<VolumeRendering>(L);
+  LuaCppObject::Register<NbodySimulation>(L);
 
   luaL_requiref(L, "hdf5", luaopen_hdf5, false);
 
@@ -4,13 +4,16 @@
 
 
 #include <vector>
+#include <pthread.h>
 #include "lua_object.hpp"
 
 extern "C" {
 #include "GL/glfw.h"
 }
 
-#define __DATASOURCE_MAXDIMS 3
+#define __DATASOURCE_MAXDIMS 4
+#define __CALLBACK_MAXARGS 16
+#define __MESH_STRIDE 7 // x, y, z, nx, ny, nz, scalar
 
 
 // Forward declarations
@@ -23,6 +26,13 @@ class ShaderProgram;
 
 class DataSource : public LuaCppObject
 {
+public:
+  struct Meshlet
+  {
+    int first; // offset of the meshlet into the index buffer
+    int count; // number of indices in the meshlet
+    int base;  // vertex which the meshlet's indices are relative to
+  } ;
 protected:
   typedef std::map<std::string, DataSource*> DataSourceMap;
 
@@ -35,25 +45,36 @@ protected:
   GLuint             __texture_id;
   GLuint             __vbo_id;
   GLuint             __ibo_id;
+  GLenum             __index_type; // type of the indices in __ibo_id
+  DataSource*        __index_source; // if not NULL, indices are shared from it
+  bool               __indices_staged; // if true indices need to be uploaded
+  std::vector<Meshlet> __meshlets;
   int                __texture_format; // luminance, alpha, rgba, etc
   GLenum             __texture_target; // e.g. GL_TEXTURE_1D inferred internally
 
   int __num_dimensions;
   int __num_indices;
   int __num_points[__DATASOURCE_MAXDIMS];
+  int __version; // incremented each time the buffers are refreshed
+  int __input_version; // version of __input_ds at our last refresh
+  int __bounds_version; // version at which __bounds were last found
+  double __bounds[6];
 
   // if true for component then map output into [0,1]
   bool __normalize;
 
-  void __do_normalize();
+  int __transform_version; // version of the cpu transform at our last refresh
+
+  virtual void __do_normalize();
   void __trigger_refresh();
   void __execute_gpu_transform();
-  bool __ancestor_is_staged();
   bool __staged;
 
   virtual void __refresh_cpu() { } // re-compile data from sources into cpu buffer
+  virtual bool __side_inputs_changed(); // other than __input_ds
   void __cp_gpu_to_cpu(); // copy data from texture memory to cpu buffer
   void __cp_cpu_to_gpu(); // copy data from cpu buffer to texture memory
+  void __compact_indices(std::vector<GLushort> &compact);
 
 public:
   DataSource();
@@ -68,8 +89,12 @@ public:
   int get_num_points(int d);
   int get_num_dimensions();
   int get_num_indices();
-  int get_vbo() { return __vbo_id; }
-  int get_ibo() { return __ibo_id; }
+  GLuint get_vbo() { return __vbo_id; }
+  GLuint get_ibo();
+  GLenum get_index_type();
+  const std::vector<Meshlet> &get_meshlets();
+  int get_version() { return __version; }
+  bool get_bounds(double *lo, double *hi);
 
   void set_input(DataSource *inpt);
   void set_mode(const char *mode);
@@ -84,6 +109,10 @@ public:
      ni -> __num_indices */
   void set_indices(const GLuint *indices, int ni);
 
+  /* uses the indices of `src` in place of our own, without copying them
+     src -> __index_source */
+  void share_indices(DataSource *src);
+
   void check_num_dimensions(const char *name, int ndims);
   void check_num_points(const char *name, int npnts, int dim);
   void check_has_data(const char *name);
@@ -132,31 +161,289 @@ class ParametricVertexSource3D :  public GridSource2D
 public:
   ParametricVertexSource3D();
 protected:
+  std::vector<GLfloat> __verts; // interleaved mesh, kept between refreshes
+  int __built_Nu, __built_Nv;
+  double __built_range[4];
+  void __refresh_cpu();
+  void __init_lua_objects();
+} ;
+
+class IsosurfaceSource : public DataSource
+// -----------------------------------------------------------------------------
+// The surface on which the 3d scalar DataSource given as input equals the iso
+// value, with the same "mesh", "triangles", "normals" and "scalars" outputs as
+// a ParametricVertexSource3D. The grid fills the unit cube centered on the
+// origin, as the volume of VolumeRendering does.
+// -----------------------------------------------------------------------------
+{
+public:
+  IsosurfaceSource();
+  void set_iso_value(double v);
+protected:
+  double __iso_value;
+  int __grid_shape[3]; // of the input the pyramid was built for
+  int __pyramid_version;
+  int __num_active; // blocks triangulated at the last refresh
+  std::vector<std::vector<int> > __level_shape; // blocks along each axis
+  std::vector<std::vector<GLfloat> > __level_min, __level_max;
+  void __build_pyramid(const GLfloat *f, const int *N);
+  void __find_blocks(int level, int a, int b, int c, std::vector<int> &blocks);
+  void __refresh_cpu();
+  void __init_lua_objects();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_iso_value_(lua_State *L);
+  static int _set_iso_value_(lua_State *L);
+  static int _get_num_active_blocks_(lua_State *L);
+} ;
+
+class MeshDecimationSource : public DataSource
+// -----------------------------------------------------------------------------
+// The triangle mesh given as input, either (N,3) positions or the rows of a
+// MeshSource along with their indices, simplified to at most the target number
+// of triangles, with the same outputs as a ParametricVertexSource3D.
+// -----------------------------------------------------------------------------
+{
+public:
+  MeshDecimationSource();
+  void set_target(int num_triangles);
+protected:
+  int __target;
+  int __num_triangles; // left by the last refresh
   void __refresh_cpu();
   void __init_lua_objects();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_target_(lua_State *L);
+  static int _set_target_(lua_State *L);
+  static int _get_num_triangles_(lua_State *L);
+} ;
+
+class MeshSource : public DataSource
+// -----------------------------------------------------------------------------
+// Interleaved vertices of a triangle mesh, an (N,7) array whose rows are the
+// position, normal and scalar of each vertex, along with one index buffer.
+// Normalization applies to the scalar column only.
+// -----------------------------------------------------------------------------
+{
+public:
+  MeshSource();
+  void set_grid_shape(int Nu, int Nv);
+  int get_grid_shape(int d); // 0 unless the vertices lie on a structured grid
+protected:
+  int __grid_shape[2];
+  void __do_normalize();
+} ;
+
+class MeshAttribute : public DataSource
+// -----------------------------------------------------------------------------
+// The columns [column, column + num_columns) of the MeshSource given as input,
+// sharing its indices. Only filled in when compiled, so unused attributes take
+// no memory.
+// -----------------------------------------------------------------------------
+{
+public:
+  MeshAttribute();
+  void set_columns(int column, int num_columns);
+protected:
+  int __column, __num_columns;
+  void __refresh_cpu();
+} ;
+
+class VolumeRayCaster : public DataSource
+// -----------------------------------------------------------------------------
+// The 3d scalar DataSource given as input, rendered on the CPU into an (h,w,4)
+// RGBA image, as VolumeRendering draws it in a Window with the same position,
+// orientation and scale.
+// -----------------------------------------------------------------------------
+{
+public:
+  VolumeRayCaster();
+  void write_ppm(const char *fname);
+protected:
+  int __width, __height;
+  double __position[3], __orientation[3], __scale[3];
+  double __density;
+  DataSource *__color_table;
+  int __table_version; // version of the color table at our last refresh
+  int __cells[3]; // number of macrocells along each axis
+  int __cells_version; // version of the input the cell ranges were found for
+  std::vector<GLfloat> __cell_min, __cell_max;
+  std::vector<char> __cell_empty;
+  void __build_cells(const GLfloat *data, const int *N);
+  void __flag_cells(const GLfloat *table);
+  void __refresh_cpu();
+  bool __side_inputs_changed();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _set_color_table_(lua_State *L);
+  static int _set_image_size_(lua_State *L);
+  static int _set_position_(lua_State *L);
+  static int _set_orientation_(lua_State *L);
+  static int _set_scale_(lua_State *L);
+  static int _get_density_(lua_State *L);
+  static int _set_density_(lua_State *L);
+  static int _write_ppm_(lua_State *L);
+} ;
+
+class StreamlineSource : public DataSource
+// -----------------------------------------------------------------------------
+// Field lines of the 3d vector DataSource given as input, an (N0,N1,N2,3)
+// array, through the rows of the "seeds" DataSource. The result holds the
+// points of all lines, with indices pairing them into segments for a
+// SegmentsEnsemble.
+// -----------------------------------------------------------------------------
+{
+public:
+  StreamlineSource();
+protected:
+  DataSource *__seeds;
+  int __seeds_version; // version of the seeds at our last refresh
+  int __direction; // forward, backward or both, along the field
+  double __tolerance; // largest error of each step
+  double __max_length; // of each half of a line
+  int __max_steps;
+  void __refresh_cpu();
+  bool __side_inputs_changed();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _set_seeds_(lua_State *L);
+  static int _get_direction_(lua_State *L);
+  static int _set_direction_(lua_State *L);
+  static int _get_tolerance_(lua_State *L);
+  static int _set_tolerance_(lua_State *L);
+  static int _get_max_length_(lua_State *L);
+  static int _set_max_length_(lua_State *L);
+  static int _get_max_steps_(lua_State *L);
+  static int _set_max_steps_(lua_State *L);
+} ;
+
+class SliceSource : public DataSource
+// -----------------------------------------------------------------------------
+// An oriented plane resampled out of the 3d scalar DataSource given as input,
+// as a (ny,nx) luminance image.
+// -----------------------------------------------------------------------------
+{
+public:
+  SliceSource();
+protected:
+  int __nx, __ny;
+  double __width, __height;
+  double __center[3], __orientation[3];
+  void __refresh_cpu();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_center_(lua_State *L);
+  static int _set_center_(lua_State *L);
+  static int _get_orientation_(lua_State *L);
+  static int _set_orientation_(lua_State *L);
+  static int _set_size_(lua_State *L);
+  static int _set_resolution_(lua_State *L);
+} ;
+
+class FunctionMapping : public DataSource
+{
+public:
+  FunctionMapping();
+protected:
+  void __refresh_cpu();
+} ;
+
+class PointsSource : public DataSource
+{
+public:
+  PointsSource();
+  void set_points(const double *x, int N, int dim);
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _set_points_(lua_State *L);
 } ;
 
 class CallbackFunction : public LuaCppObject
 {
 public:
+  CallbackFunction() : version(0) { }
   std::vector<double> call();
   std::vector<double> call(double u);
   std::vector<double> call(double u, double v);
   std::vector<double> call(double u, double v, double w);
-  std::vector<double> call(std::vector<double> X);
+  std::vector<double> call(const std::vector<double> &X);
+  std::vector<double> call(const double *x, int narg);
+  /* evaluates the function without allocating
+     x -> narg arguments, at most __CALLBACK_MAXARGS
+     res -> room for __CALLBACK_MAXARGS values
+     returns the number of values written to res */
+  int call(const double *x, int narg, double *res);
+  /* evaluates the function at N points at once
+     x -> narg columns of length N, i.e. x[k*N + n] is argument k of point n
+     res -> nret columns of length N, where nret is the return value */
+  int call_batch(const double *x, int narg, int N, std::vector<double> &res);
+  virtual bool supports_batch() { return false; }
   void set_message(const char *msg) { message = msg; }
   const char *get_message() { return message.c_str(); }
-  static CallbackFunction *CallbackFunction::create_from_stack(lua_State *L, int pos);
+  int get_version() { return version; }
+  static CallbackFunction *create_from_stack(lua_State *L, int pos);
 private:
   std::string message;
-  virtual std::vector<double> call_priv(double *x, int narg) = 0;
+  virtual int call_priv(const double *x, int narg, double *res) = 0;
   int _call();
+protected:
+  int version; // incremented whenever the function's definition changes
+  virtual int call_batch_priv(const double *x, int narg, int N,
+                              std::vector<double> &res);
 } ;
 
 class LuaFunction : public CallbackFunction
 {
+public:
+  LuaFunction() : batched(false) { }
+  virtual ~LuaFunction();
+  void set_batched(bool mode) { batched = mode; }
+  void set_parallel(int nstates);
+  bool supports_batch() { return batched || !workers.empty(); }
+private:
+  bool batched; // if true the Lua function is called with lunum arrays
+  std::vector<lua_State*> workers; // private states for parallel evaluation
+  virtual int call_priv(const double *x, int narg, double *res);
+  virtual int call_batch_priv(const double *x, int narg, int N,
+                              std::vector<double> &res);
+  int __call_parallel(const double *x, int narg, int N,
+                      std::vector<double> &res);
+  void __sync_upvalues();
+  void __close_workers();
+} ;
+
+class ExpressionFunction : public CallbackFunction
+{
+public:
+  struct Instruction
+  {
+    int op, arg;
+  } ;
+  typedef std::vector<Instruction> Program;
+  ExpressionFunction();
+  void set_expression(const char *expr);
+  void set_parameter(const char *name, double value);
+  bool supports_batch() { return true; }
 private:
-  virtual std::vector<double> call_priv(double *x, int narg);
+  std::string expression;
+  std::vector<Program> programs; // one for each value returned
+  std::vector<double> constants;
+  std::vector<double> params;
+  std::map<std::string, int> param_index;
+  int stack_depth;
+  int num_args;
+  void evaluate(const double *x, int N, int n0, int nb, double *stack,
+                double *res);
+  virtual int call_priv(const double *x, int narg, double *res);
+  virtual int call_batch_priv(const double *x, int narg, int N,
+                              std::vector<double> &res);
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_expression_(lua_State *L);
+  static int _set_expression_(lua_State *L);
+  static int _get_parameter_(lua_State *L);
+  static int _set_parameter_(lua_State *L);
 } ;
 
 class ColormapCollection : public DataSource
@@ -201,6 +488,51 @@ protected:
   static int _load_poly_(lua_State *L);
 } ;
 
+class TimeSeriesSource : public DataSource
+{
+public:
+  TimeSeriesSource();
+  virtual ~TimeSeriesSource();
+  void add_frame(const char *fname, const char *dset);
+  void set_frame(int n);
+  void set_window(int behind, int ahead); // number of frames kept around
+  int get_num_frames();
+private:
+  struct Frame
+  {
+    std::string fname, dset;
+    GLfloat *data;
+    int num_dimensions;
+    int num_points[__DATASOURCE_MAXDIMS];
+    int status;
+  } ;
+  std::vector<Frame> __frames;
+  int __current;  // the frame requested by the user
+  int __resident; // the frame whose buffer is lent to __cpu_data, or -1
+  bool __resident_normalized; // whether that buffer was normalized in place
+  int __behind, __ahead;
+  bool __shutdown;
+  pthread_t __loader;
+  pthread_mutex_t __lock;
+  pthread_cond_t __wake;   // tells the loader the window has moved
+  pthread_cond_t __loaded; // tells the main thread a frame was read
+  void __refresh_cpu();
+  bool __in_window(int n);
+  int __next_to_load();
+  void __evict();
+  void __loader_loop();
+  static void *__loader_main(void *self);
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _add_frame_(lua_State *L);
+  static int _get_frame_(lua_State *L);
+  static int _set_frame_(lua_State *L);
+  static int _next_frame_(lua_State *L);
+  static int _prev_frame_(lua_State *L);
+  static int _set_window_(lua_State *L);
+  static int _get_num_frames_(lua_State *L);
+} ;
+
 
 
 
@@ -214,6 +546,7 @@ protected:
   static int _set_##prop##_(lua_State *L) {                             \
     LuviewTraitedObject *self = checkarg<LuviewTraitedObject>(L, 1);    \
     lua_remove(L, 1);                                                   \
+    ++self->Revision;                                                   \
     return __set_vec__(L, &self->prop, 1);                              \
   }                                                                     \
   // ---------------------------------------------------------------------------
@@ -226,6 +559,7 @@ protected:
   static int _set_##prop##_(lua_State *L) {                             \
     LuviewTraitedObject *self = checkarg<LuviewTraitedObject>(L, 1);    \
     lua_remove(L, 1);                                                   \
+    ++self->Revision;                                                   \
     return __set_vec__(L, self->prop, 3);                               \
   }                                                                     \
   // ---------------------------------------------------------------------------
@@ -240,6 +574,7 @@ protected:
   double Scale[3];
   double LineWidth;
   double Alpha;
+  int Revision; // incremented whenever the object is changed through Lua
   std::map<std::string, CallbackFunction*> Callbacks;
   std::map<std::string, DataSource*> DataSources;
   typedef std::map<std::string, CallbackFunction*>::iterator EntryCB;
@@ -247,6 +582,7 @@ protected:
 
 public:
   LuviewTraitedObject();
+  virtual void get_state(std::vector<double> &state);
 
 protected:
   virtual LuaInstanceMethod __getattr__(std::string &method_name);
@@ -278,11 +614,15 @@ class ShaderProgram : public LuaCppObject
 {
 private:
   GLuint vert, frag, prog;
-  GLint prev_prog;
+  GLuint prev_prog;
+  int version; // incremented whenever the program is replaced
 public:
   ShaderProgram();
   virtual ~ShaderProgram();
+  GLuint get_id() { return prog; }
+  int get_version() { return version; }
   void set_uniform(const char *name, GLint value);
+  void set_uniform_vec(const char *name, const GLfloat *value, int n);
   void set_program(const char *vert_src, const char *frag_src);
   void unset_program();
   void activate();
@@ -295,6 +635,91 @@ protected:
   static int _set_program_(lua_State *L);
 } ;
 
+class CylinderBatch
+// -----------------------------------------------------------------------------
+// Tubes of a given radius along a list of segments. The segments are baked
+// from a cached unit cylinder into one vertex and index buffer, so that all of
+// them are drawn with a single call.
+// -----------------------------------------------------------------------------
+{
+public:
+  CylinderBatch(int slices);
+  ~CylinderBatch();
+  void build(const GLfloat *verts, const GLuint *indices, int nseg,
+             GLfloat radius);
+  void draw();
+private:
+  int slices;
+  int num_indices;
+  GLuint vbo, ibo;
+} ;
+
+class GLStateCache
+// -----------------------------------------------------------------------------
+// Shadows the capabilities, program, line width and material switched between
+// actors, and forwards only the changes to OpenGL.
+// -----------------------------------------------------------------------------
+{
+public:
+  static void reset();
+  static void set_modes(const std::vector<int> &modes);
+  static void force(GLenum cap);
+  static void enable(GLenum cap);
+  static void disable(GLenum cap);
+  static void use_program(GLuint prog);
+  static GLuint get_program();
+  static void line_width(double w);
+  static void material(double a);
+private:
+  static std::map<GLenum, bool> enabled;
+  static std::vector<int> forced; // kept enabled whatever the modes
+  static GLuint program;
+  static double width;
+  static double alpha;
+} ;
+
+class FrameBuffer
+// -----------------------------------------------------------------------------
+// An offscreen RGBA texture, of 8 bit or half float channels, with a depth
+// renderbuffer of its own or borrowed from `depth_from`.
+// -----------------------------------------------------------------------------
+{
+public:
+  FrameBuffer(bool floating, FrameBuffer *depth_from=NULL);
+  ~FrameBuffer();
+  bool resize(int w, int h);
+  void bind();
+  void release(); // rebinds the target which was bound before bind()
+  static void unbind();
+  GLuint get_texture() { return texture; }
+private:
+  GLenum format;
+  FrameBuffer *depth_from;
+  GLuint fbo, texture, depth;
+  int width, height;
+  GLint previous;
+} ;
+
+class ViewFrustum
+// -----------------------------------------------------------------------------
+// The six clipping planes of a combined projection and modelview matrix, in
+// the coordinates the matrix acts on. Matrices are column major as in OpenGL,
+// and the helpers multiply on the right as glTranslate and friends do.
+// -----------------------------------------------------------------------------
+{
+public:
+  ViewFrustum(const double *PM);
+  bool intersects(const double *lo, const double *hi) const;
+  static void identity(double *M);
+  static void multiply(const double *A, const double *B, double *C);
+  static void translate(double *M, double x, double y, double z);
+  static void scale(double *M, double x, double y, double z);
+  static void rotate(double *M, double angle, int axis);
+  static bool invert(const double *M, double *Minv);
+private:
+  double planes[6][4];
+} ;
+
 class DrawableObject : public LuviewTraitedObject
 {
 protected:
@@ -303,6 +728,13 @@ protected:
 public:
   DrawableObject();
   virtual void draw();
+  virtual bool get_bounds(double *lo, double *hi);
+  virtual double get_pixel_margin() { return 0.0; }
+  void get_state(std::vector<double> &state);
+  void get_transform(double *M);
+  bool is_visible(const double *P, const double *V, int width, int height);
+  bool is_translucent() { return Alpha < 1.0; }
+  bool sorts_before(DrawableObject *other);
 protected:
   virtual void draw_local() = 0;
 protected:
@@ -315,8 +747,21 @@ class VolumeRendering : public DrawableObject
 {
 public:
   VolumeRendering();
+  virtual ~VolumeRendering();
 private:
+  double density; // opacity per unit length, for a color table alpha of one
+  FrameBuffer *entry_fb, *exit_fb; // ray end points, from the cube's faces
+  ShaderProgram *march_shader;
+  GLuint bricks; // 3d texture flagging the bricks which are fully transparent
+  int brick_count[3];
+  DataSource *bricks_volume, *bricks_table; // sources the flags were built from
+  int bricks_volume_version, bricks_table_version;
+  void build_bricks(DataSource *vol, DataSource *lut);
   void draw_local();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_density_(lua_State *L);
+  static int _set_density_(lua_State *L);
 } ;
 
 class NbodySimulation : public LuaCppObject
@@ -356,6 +801,8 @@ class BoundingBox : public DrawableObject
 public:
   BoundingBox();
 private:
+  CylinderBatch edges;
+  double edges_width; // line width the edges were last built with
   void draw_local();
 } ;
 
@@ -372,8 +819,15 @@ class ParametricSurface : public DrawableObject
 {
 public:
   ParametricSurface();
+  virtual ~ParametricSurface();
 private:
   GLfloat Lx0, Lx1, Ly0, Ly1;
+  GLuint vbo, ibo;
+  DataSource *built_source; // points the buffers were last built from
+  int built_version;
+  int built_Nx, built_Ny;
+  void build_vertices(const GLfloat *data, int Nx, int Ny);
+  void build_indices(int Nx, int Ny);
   void draw_local();
 } ;
 
@@ -381,17 +835,106 @@ class SegmentsEnsemble : public DrawableObject
 {
 public:
   SegmentsEnsemble();
+  virtual ~SegmentsEnsemble();
 private:
+  int mode;
+  CylinderBatch tubes;
+  DataSource *tubes_source; // segments the tubes were last built from
+  int tubes_version;
+  double tubes_width;
+  GLuint ribbon_vbo, ribbon_ibo; // quads expanded to thick lines on the GPU
+  DataSource *ribbon_source;
+  int ribbon_version;
+  ShaderProgram *ribbon_shader;
+  void build_ribbons(const GLfloat *verts, const GLuint *indices, int nseg);
   void draw_local();
+  bool get_bounds(double *lo, double *hi);
+  double get_pixel_margin();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_mode_(lua_State *L);
+  static int _set_mode_(lua_State *L);
+} ;
+
+class PointsEnsemble : public DrawableObject
+{
+public:
+  PointsEnsemble();
+private:
+  ShaderProgram *sprite_shader;
+  DataSource *sizes_source; // sizes the largest one was last found from
+  int sizes_version;
+  double sizes_max;
+  void draw_local();
+  double get_pixel_margin();
 } ;
 
 class TrianglesEnsemble : public DrawableObject
 {
 public:
   TrianglesEnsemble();
+  virtual ~TrianglesEnsemble();
 private:
+  GLuint normals_vbo; // used when no "normals" DataSource is given
+  DataSource *normals_source; // triangles the normals were last built from
+  int normals_version;
+  void build_normals(const GLfloat *verts, int Nv, const GLuint *indices,
+                     int Nt);
   void draw_local();
 } ;
 
+class TerrainSurface : public DrawableObject
+{
+public:
+  TerrainSurface();
+  virtual ~TerrainSurface();
+private:
+  struct Chunk
+  {
+    int level, a, b; // covers quads [a, a+1) x [b, b+1) times chunk << level
+    double error; // in pixels on screen
+    bool operator<(const Chunk &c) const { return error < c.error; }
+  } ;
+  int chunk; // number of quads along the side of a chunk
+  int num_levels;
+  int grid_Nu, grid_Nv;
+  int pattern_Nv;
+  double tolerance; // largest screen-space error allowed, in pixels
+  int budget; // largest number of triangles drawn
+  int num_drawn;
+  int num_culled;
+  MeshSource *built_source;
+  int built_version;
+  std::vector<std::vector<GLfloat> > errors; // per level, per chunk
+  std::vector<std::vector<GLfloat> > zmin, zmax;
+  std::vector<std::vector<char> > state; // of each chunk in the current cut
+  std::vector<GLuint> patterns; // one index buffer per level
+  std::vector<GLuint> extra; // indices of clipped chunks and crack fillers
+  GLuint extra_ibo;
+  int levels_across(int level) const;
+  bool is_empty(int level, int a, int b) const;
+  GLuint vertex(int i, int j) const;
+  void build_tree(const GLfloat *verts);
+  void build_patterns();
+  void chunk_bounds(const GLfloat *verts, int level, int a, int b,
+                    double *lo, double *hi);
+  double screen_error(int level, int a, int b, const double *lo,
+                      const double *hi, const double *M, const double *P,
+                      const double *V);
+  void select_chunks(const GLfloat *verts, std::vector<Chunk> &cut);
+  void emit_clipped(const Chunk &c);
+  void emit_stitches(const Chunk &c);
+  void draw_local();
+protected:
+  virtual LuaInstanceMethod __getattr__(std::string &method_name);
+  static int _get_tolerance_(lua_State *L);
+  static int _set_tolerance_(lua_State *L);
+  static int _get_budget_(lua_State *L);
+  static int _set_budget_(lua_State *L);
+  static int _set_chunk_size_(lua_State *L);
+  static int _get_num_triangles_(lua_State *L);
+  static int _get_num_culled_(lua_State *L);
+} ;
+
 
 #endif // __LuviewObjects_HEADER__
@@ -0,0 +1,422 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * VolumeRayCaster: renders a 3d scalar DataSource into an RGBA image on the
+ * CPU, for machines which have no GPU to run VolumeRendering on.
+ *
+ * NOTES:
+ *
+ * The camera is that of a Window with the same position, orientation and
+ * scale, and the volume fills the unit cube centered on the origin, so that
+ * the image matches what VolumeRendering draws. Like the Window's, the camera
+ * turns about the x and y axes only, and the third angle is ignored. Rays are
+ * marched front to back in half voxel steps through the "color_table", and
+ * stop once all but opaque.
+ *
+ * The image is split into square tiles, which are handed out to the threads
+ * one at a time so that tiles crossing dense parts of the volume do not hold
+ * up the rest. Within a tile the rays are cast in packets of 2x2 neighboring
+ * pixels, which march in lock step and so read nearby voxels together.
+ *
+ * The volume is divided into macrocells of 8^3 voxels whose value ranges are
+ * kept between frames. Cells through which the color table is transparent are
+ * crossed by the rays in one step.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "luview.hpp"
+#include "trilinear.hpp"
+#include "bricks.hpp"
+
+#define __RAYCAST_CELL 8 // number of voxels along the side of a macrocell
+#define __RAYCAST_TILE 16 // number of pixels along the side of a tile
+#define __RAYCAST_PACKET 4 // rays in a packet, a 2x2 block of pixels
+
+
+struct RayScene
+{
+  const GLfloat *data; // the volume
+  const GLfloat *table; // 256 rgba entries
+  const char *empty; // flags of the transparent macrocells
+  int N[3];
+  int cells[3];
+  double eye[3];
+  double step;
+  double density;
+} ;
+
+static void lookup(const GLfloat *table, double v, double *c)
+// -----------------------------------------------------------------------------
+// Samples the color table at v in [0,1] as a linear filtered texture would.
+// -----------------------------------------------------------------------------
+{
+  const double x = std::min(std::max(v*256 - 0.5, 0.0), 255.0);
+  const int i = std::min((int) x, 254);
+  const double w = x - i;
+  for (int k=0; k<4; ++k) {
+    c[k] = table[4*i + k] + w*(table[4*(i + 1) + k] - table[4*i + k]);
+  }
+}
+
+static void cast_packet(const RayScene &S, double dir[][3], int nrays,
+                        double rgba[][4])
+// -----------------------------------------------------------------------------
+// Marches up to __RAYCAST_PACKET rays from the eye along the unit vectors
+// `dir`, writing the color and opacity gathered by each, with the color
+// premultiplied by opacity.
+// -----------------------------------------------------------------------------
+{
+  const int B = __RAYCAST_CELL;
+  const int *N = S.N;
+  double t[__RAYCAST_PACKET], t1[__RAYCAST_PACKET];
+  bool active[__RAYCAST_PACKET];
+  int num_active = 0;
+
+  for (int r=0; r<nrays; ++r) {
+    double tnear = -1e30, tfar = 1e30;
+    for (int a=0; a<3; ++a) {
+      const double d = dir[r][a] == 0.0 ? 1e-12 : dir[r][a];
+      const double ta = (-0.5 - S.eye[a]) / d;
+      const double tb = (+0.5 - S.eye[a]) / d;
+      tnear = std::max(tnear, std::min(ta, tb));
+      tfar = std::min(tfar, std::max(ta, tb));
+    }
+    t[r] = std::max(tnear, 0.0) + 0.5*S.step;
+    t1[r] = tfar;
+    active[r] = t[r] < t1[r];
+    num_active += active[r];
+    rgba[r][0] = rgba[r][1] = rgba[r][2] = rgba[r][3] = 0.0;
+  }
+
+  while (num_active > 0) {
+    for (int r=0; r<nrays; ++r) {
+      if (!active[r]) continue;
+      if (t[r] >= t1[r]) {
+        active[r] = false;
+        --num_active;
+        continue;
+      }
+      const double *d = dir[r];
+      double *acc = rgba[r];
+
+      // Texture coordinates: s along the last axis of the volume, r the first.
+      const double s[3] = { S.eye[0] + t[r]*d[0] + 0.5,
+                            S.eye[1] + t[r]*d[1] + 0.5,
+                            S.eye[2] + t[r]*d[2] + 0.5 };
+      int cell[3];
+      for (int a=0; a<3; ++a) {
+        const int n = N[2 - a];
+        cell[a] = std::min(std::max((int) floor(s[a]*n / B), 0),
+                           S.cells[2 - a] - 1);
+      }
+      if (S.empty[(cell[2]*S.cells[1] + cell[1])*S.cells[2] + cell[0]]) {
+        double skip = 1e30;
+        for (int a=0; a<3; ++a) {
+          const double bound = (cell[a] + (d[a] >= 0.0)) * double(B) / N[2 - a];
+          skip = std::min(skip, fabs((bound - s[a]) /
+                                     std::max(fabs(d[a]), 1e-12)));
+        }
+        t[r] += std::max(ceil(skip / S.step), 1.0) * S.step;
+        continue;
+      }
+
+      double c[4];
+      const double v = trilinear(S.data, N, s[2]*N[0] - 0.5, s[1]*N[1] - 0.5,
+                                 s[0]*N[2] - 0.5);
+      lookup(S.table, v, c);
+      const double alpha = 1.0 - exp(-S.density * c[3] * S.step);
+      const double w = (1.0 - acc[3]) * alpha;
+      acc[0] += w * c[0];
+      acc[1] += w * c[1];
+      acc[2] += w * c[2];
+      acc[3] += w;
+      t[r] += S.step;
+
+      if (acc[3] >= 0.99) {
+        active[r] = false;
+        --num_active;
+      }
+    }
+  }
+}
+
+
+VolumeRayCaster::VolumeRayCaster()
+  : __width(512),
+    __height(512),
+    __density(5.0),
+    __color_table(NULL),
+    __table_version(-1),
+    __cells_version(-1)
+{
+  __position[0] = 0.0;
+  __position[1] = 0.0;
+  __position[2] = -2.0;
+  __orientation[0] = 9.0;
+  __orientation[1] = 0.0;
+  __orientation[2] = 0.0;
+  __scale[0] = __scale[1] = __scale[2] = 1.0;
+  __cells[0] = __cells[1] = __cells[2] = 0;
+  set_mode("rgba");
+}
+
+bool VolumeRayCaster::__side_inputs_changed()
+{
+  if (DataSource::__side_inputs_changed()) return true;
+  if (__color_table == NULL) return false;
+  __color_table->compile();
+  return __color_table->get_version() != __table_version;
+}
+
+void VolumeRayCaster::__build_cells(const GLfloat *data, const int *N)
+// -----------------------------------------------------------------------------
+// Finds the value range of each macrocell. The range takes in the voxels one
+// beyond the cell's faces, which the linear filter blends into samples taken
+// inside it.
+// -----------------------------------------------------------------------------
+{
+  const int B = __RAYCAST_CELL;
+  for (int d=0; d<3; ++d) __cells[d] = (N[d] + B - 1) / B;
+  const int Nc = __cells[0]*__cells[1]*__cells[2];
+  __cell_min.resize(Nc);
+  __cell_max.resize(Nc);
+  brick_ranges(data, N, B, 1, __cells, &__cell_min[0], &__cell_max[0]);
+}
+
+void VolumeRayCaster::__flag_cells(const GLfloat *table)
+// -----------------------------------------------------------------------------
+// Flags the cells through which the color table is transparent, taking in the
+// entries either side of the cell's range.
+// -----------------------------------------------------------------------------
+{
+  const int Nc = __cell_min.size();
+  __cell_empty.resize(Nc);
+
+  for (int n=0; n<Nc; ++n) {
+    __cell_empty[n] = table_is_transparent(table, __cell_min[n], __cell_max[n]);
+  }
+}
+
+void VolumeRayCaster::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  if (__color_table == NULL) {
+    luaL_error(__lua_state, "need a color table\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 3);
+  __color_table->check_has_data("color_table");
+  __color_table->check_num_dimensions("color_table", 2);
+  __color_table->check_num_points("color_table", 256, 0);
+  __color_table->check_num_points("color_table", 4, 1);
+
+  RayScene S;
+  bool resized = false;
+  for (int d=0; d<3; ++d) {
+    S.N[d] = __input_ds->get_num_points(d);
+    resized |= __cells[d] != (S.N[d] + __RAYCAST_CELL - 1) / __RAYCAST_CELL;
+  }
+  if (resized || __cells_version != __input_ds->get_version()) {
+    __build_cells(__input_ds->get_data(), S.N);
+    __cells_version = __input_ds->get_version();
+  }
+  __flag_cells(__color_table->get_data());
+  __table_version = __color_table->get_version();
+
+  // The view matrix of a Window with our position, orientation and scale, and
+  // its inverse, which takes the eye and the rays into the volume's
+  // coordinates.
+  double V[16], Vinv[16];
+  ViewFrustum::identity(V);
+  ViewFrustum::translate(V, __position[0], __position[1], __position[2]);
+  ViewFrustum::rotate(V, __orientation[0], 0);
+  ViewFrustum::rotate(V, __orientation[1], 1);
+  ViewFrustum::scale(V, __scale[0], __scale[1], __scale[2]);
+  if (!ViewFrustum::invert(V, Vinv)) {
+    luaL_error(__lua_state, "the camera transform is singular");
+  }
+
+  S.data = __input_ds->get_data();
+  S.table = __color_table->get_data();
+  S.empty = &__cell_empty[0];
+  for (int d=0; d<3; ++d) {
+    S.cells[d] = __cells[d];
+    S.eye[d] = Vinv[12 + d] / Vinv[15];
+  }
+  S.step = 0.5 / std::max(S.N[0], std::max(S.N[1], S.N[2]));
+  S.density = __density;
+
+  const int W = __width;
+  const int H = __height;
+  const int T = __RAYCAST_TILE;
+  const int tx = (W + T - 1) / T;
+  const int ty = (H + T - 1) / T;
+  const double f = tan(0.5 * 45.0 * M_PI / 180.0); // as the Window's gluPerspective
+  const double aspect = double(W) / H;
+
+  __cpu_data = (GLfloat*) realloc(__cpu_data, W*H*4*sizeof(GLfloat));
+  GLfloat *image = __cpu_data;
+
+#pragma omp parallel for schedule(dynamic)
+  for (int n=0; n<tx*ty; ++n) {
+    const int x0 = (n % tx) * T, x1 = std::min(x0 + T, W);
+    const int y0 = (n / tx) * T, y1 = std::min(y0 + T, H);
+
+    for (int y=y0; y<y1; y+=2) {
+      for (int x=x0; x<x1; x+=2) {
+        double dir[__RAYCAST_PACKET][3];
+        double rgba[__RAYCAST_PACKET][4];
+        int pix[__RAYCAST_PACKET];
+        int nrays = 0;
+
+        for (int py=y; py<std::min(y + 2, y1); ++py) {
+          for (int px=x; px<std::min(x + 2, x1); ++px) {
+            const double e[3] = { (2.0*(px + 0.5)/W - 1.0) * f * aspect,
+                                  (2.0*(py + 0.5)/H - 1.0) * f, -1.0 };
+            double *d = dir[nrays];
+            double norm = 0.0;
+            for (int a=0; a<3; ++a) {
+              d[a] = Vinv[a]*e[0] + Vinv[4 + a]*e[1] + Vinv[8 + a]*e[2];
+              norm += d[a]*d[a];
+            }
+            norm = sqrt(norm);
+            for (int a=0; a<3; ++a) d[a] /= norm;
+            pix[nrays++] = py*W + px;
+          }
+        }
+        cast_packet(S, dir, nrays, rgba);
+
+        for (int r=0; r<nrays; ++r) {
+          GLfloat *p = image + 4*pix[r];
+          const double a = rgba[r][3];
+          for (int k=0; k<3; ++k) p[k] = a > 0.0 ? rgba[r][k] / a : 0.0;
+          p[3] = a;
+        }
+      }
+    }
+  }
+
+  __num_dimensions = 3;
+  __num_points[0] = H;
+  __num_points[1] = W;
+  __num_points[2] = 4;
+}
+
+void VolumeRayCaster::write_ppm(const char *fname)
+// -----------------------------------------------------------------------------
+// Writes the image over a black background, top row first.
+// -----------------------------------------------------------------------------
+{
+  compile();
+  check_has_data(_get_type().c_str());
+
+  const int W = __num_points[1];
+  const int H = __num_points[0];
+  std::vector<unsigned char> pixels(3*W*H);
+
+  for (int y=0; y<H; ++y) {
+    const GLfloat *row = __cpu_data + 4*(H - 1 - y)*W;
+    for (int x=0; x<W; ++x) {
+      for (int k=0; k<3; ++k) {
+        const double c = row[4*x + k] * row[4*x + 3];
+        pixels[3*(y*W + x) + k] = (unsigned char) (255 * std::min(c, 1.0) + 0.5);
+      }
+    }
+  }
+
+  FILE *fp = fopen(fname, "wb");
+  if (fp == NULL) {
+    luaL_error(__lua_state, "could not create image with filename %s", fname);
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", W, H);
+  fwrite(&pixels[0], sizeof(unsigned char), pixels.size(), fp);
+  fclose(fp);
+}
+
+
+VolumeRayCaster::LuaInstanceMethod
+VolumeRayCaster::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["set_color_table"] = _set_color_table_;
+  attr["set_image_size"] = _set_image_size_;
+  attr["set_position"] = _set_position_;
+  attr["set_orientation"] = _set_orientation_;
+  attr["set_scale"] = _set_scale_;
+  attr["get_density"] = _get_density_;
+  attr["set_density"] = _set_density_;
+  attr["write_ppm"] = _write_ppm_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int VolumeRayCaster::_set_color_table_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  self->__color_table = self->replace(self->__color_table, 2);
+  self->__table_version = -1;
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_set_image_size_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  const int w = luaL_checkinteger(L, 2);
+  const int h = luaL_checkinteger(L, 3);
+  if (w < 1 || h < 1) {
+    luaL_error(L, "image size must be positive");
+  }
+  self->__width = w;
+  self->__height = h;
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_set_position_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  for (int d=0; d<3; ++d) self->__position[d] = luaL_checknumber(L, d + 2);
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_set_orientation_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  for (int d=0; d<3; ++d) self->__orientation[d] = luaL_checknumber(L, d + 2);
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_set_scale_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  for (int d=0; d<3; ++d) self->__scale[d] = luaL_checknumber(L, d + 2);
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_get_density_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  lua_pushnumber(L, self->__density);
+  return 1;
+}
+int VolumeRayCaster::_set_density_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  const double d = luaL_checknumber(L, 2);
+  if (d < 0.0) {
+    luaL_error(L, "density must be non-negative");
+  }
+  self->__density = d;
+  self->__staged = true;
+  return 0;
+}
+int VolumeRayCaster::_write_ppm_(lua_State *L)
+{
+  VolumeRayCaster *self = checkarg<VolumeRayCaster>(L, 1);
+  self->write_ppm(luaL_checkstring(L, 2));
+  return 0;
+}
@@ -6,7 +6,7 @@
 #include "luview.hpp"
 
 
-ShaderProgram::ShaderProgram() : vert(0), frag(0), prog(0) { }
+ShaderProgram::ShaderProgram() : vert(0), frag(0), prog(0), version(0) { }
 
 void ShaderProgram::set_program(const char *vert_src, const char *frag_src)
 {
@@ -31,20 +31,22 @@ void ShaderProgram::set_program(const char *vert_src, const char *frag_src)
   printShaderInfoLog(vert);
   printShaderInfoLog(frag);
   printProgramInfoLog(prog);
+  ++version;
 }
 
 void ShaderProgram::activate()
 {
-  glGetIntegerv(GL_CURRENT_PROGRAM, &prev_prog);
-  glUseProgram(prog);
+  prev_prog = GLStateCache::get_program();
+  GLStateCache::use_program(prog);
 }
 void ShaderProgram::deactivate()
 {
-  glUseProgram(prev_prog);
+  GLStateCache::use_program(prev_prog);
 }
 
 void ShaderProgram::unset_program()
 {
+  if (GLStateCache::get_program() == prog) GLStateCache::use_program(0);
   glDetachShader(prog, vert);
   glDetachShader(prog, frag);
   glDeleteShader(vert);
@@ -91,13 +93,29 @@ void ShaderProgram::printProgramInfoLog(GLuint obj)
 void ShaderProgram::set_uniform(const char *name, GLint value)
 {
   GLint loc = glGetUniformLocation(prog, name);
-  GLint existing_pro; // save the existing program state
-  glGetIntegerv(GL_CURRENT_PROGRAM, &existing_pro);
+  const GLuint existing_pro = GLStateCache::get_program(); // save the state
 
-  glUseProgram(prog);
+  GLStateCache::use_program(prog);
   glUniform1i(loc, value);
 
-  glUseProgram(existing_pro); // replace the existing program
+  GLStateCache::use_program(existing_pro); // replace the existing program
+}
+
+void ShaderProgram::set_uniform_vec(const char *name, const GLfloat *value,
+                                    int n)
+{
+  GLint loc = glGetUniformLocation(prog, name);
+  const GLuint existing_pro = GLStateCache::get_program(); // save the state
+
+  GLStateCache::use_program(prog);
+  switch (n) {
+  case 1: glUniform1fv(loc, 1, value); break;
+  case 2: glUniform2fv(loc, 1, value); break;
+  case 3: glUniform3fv(loc, 1, value); break;
+  case 4: glUniform4fv(loc, 1, value); break;
+  }
+
+  GLStateCache::use_program(existing_pro); // replace the existing program
 }
 
 ShaderProgram::LuaInstanceMethod ShaderProgram::__getattr__
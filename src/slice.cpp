@@ -0,0 +1,159 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * SliceSource: a plane of any position and orientation resampled out of a 3d
+ * scalar DataSource, as a 2d luminance image for an ImagePlane.
+ *
+ * NOTES:
+ *
+ * Like the volume of VolumeRendering, the grid fills the unit cube centered on
+ * the origin, with x along its last axis and z along its first. The plane is
+ * the rectangle of the given width and height in the xy plane, rotated by the
+ * orientation angles as an actor's would be, and centered on the given point.
+ * The image has shape (ny,nx), so that its rows run along the plane's own x
+ * axis as the ImagePlane draws them. Pixels outside the grid are zero.
+ *
+ * Each row is resampled by one thread, stepping a position through the grid
+ * by a constant offset per pixel.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include "luview.hpp"
+#include "trilinear.hpp"
+
+
+SliceSource::SliceSource()
+  : __nx(256),
+    __ny(256),
+    __width(1.0),
+    __height(1.0)
+{
+  for (int d=0; d<3; ++d) {
+    __center[d] = 0.0;
+    __orientation[d] = 0.0;
+  }
+  set_mode("luminance");
+}
+
+void SliceSource::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 3);
+
+  const GLfloat *f = __input_ds->get_data();
+  int N[3];
+  for (int d=0; d<3; ++d) N[d] = __input_ds->get_num_points(d);
+
+  // The plane's axes are the first two columns of its rotation.
+  double R[16];
+  ViewFrustum::identity(R);
+  ViewFrustum::rotate(R, __orientation[0], 0);
+  ViewFrustum::rotate(R, __orientation[1], 1);
+  ViewFrustum::rotate(R, __orientation[2], 2);
+
+  // Positions in continuous indices of the grid's axes 0, 1 and 2, which are
+  // z, y and x.
+  double origin[3], du[3], dv[3];
+  for (int a=0; a<3; ++a) {
+    const int d = 2 - a; // the spatial axis along grid axis a
+    const double ex = __width / __nx * R[d]; // from one pixel to the next
+    const double ey = __height / __ny * R[4 + d];
+    const double first = __center[d] - 0.5*(__nx - 1)*ex - 0.5*(__ny - 1)*ey;
+    origin[a] = (first + 0.5)*N[a] - 0.5;
+    du[a] = ex*N[a];
+    dv[a] = ey*N[a];
+  }
+
+  const int nx = __nx;
+  const int ny = __ny;
+  __cpu_data = (GLfloat*) realloc(__cpu_data, nx*ny*sizeof(GLfloat));
+  GLfloat *image = __cpu_data;
+
+#pragma omp parallel for schedule(static)
+  for (int j=0; j<ny; ++j) {
+    double x[3] = { origin[0] + j*dv[0], origin[1] + j*dv[1],
+                    origin[2] + j*dv[2] };
+    GLfloat *row = image + j*nx;
+    for (int i=0; i<nx; ++i) {
+      const bool inside =
+        x[0] >= -0.5 && x[0] <= N[0] - 0.5 &&
+        x[1] >= -0.5 && x[1] <= N[1] - 0.5 &&
+        x[2] >= -0.5 && x[2] <= N[2] - 0.5;
+      row[i] = inside ? trilinear(f, N, x[0], x[1], x[2]) : 0.0;
+      x[0] += du[0];
+      x[1] += du[1];
+      x[2] += du[2];
+    }
+  }
+
+  __num_dimensions = 2;
+  __num_points[0] = ny;
+  __num_points[1] = nx;
+}
+
+
+SliceSource::LuaInstanceMethod
+SliceSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_center"] = _get_center_;
+  attr["set_center"] = _set_center_;
+  attr["get_orientation"] = _get_orientation_;
+  attr["set_orientation"] = _set_orientation_;
+  attr["set_size"] = _set_size_;
+  attr["set_resolution"] = _set_resolution_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int SliceSource::_get_center_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  for (int d=0; d<3; ++d) lua_pushnumber(L, self->__center[d]);
+  return 3;
+}
+int SliceSource::_set_center_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  for (int d=0; d<3; ++d) self->__center[d] = luaL_checknumber(L, d + 2);
+  self->__staged = true;
+  return 0;
+}
+int SliceSource::_get_orientation_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  for (int d=0; d<3; ++d) lua_pushnumber(L, self->__orientation[d]);
+  return 3;
+}
+int SliceSource::_set_orientation_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  for (int d=0; d<3; ++d) self->__orientation[d] = luaL_checknumber(L, d + 2);
+  self->__staged = true;
+  return 0;
+}
+int SliceSource::_set_size_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  self->__width = luaL_checknumber(L, 2);
+  self->__height = luaL_checknumber(L, 3);
+  self->__staged = true;
+  return 0;
+}
+int SliceSource::_set_resolution_(lua_State *L)
+{
+  SliceSource *self = checkarg<SliceSource>(L, 1);
+  const int nx = luaL_checkinteger(L, 2);
+  const int ny = luaL_checkinteger(L, 3);
+  if (nx < 1 || ny < 1) {
+    luaL_error(L, "resolution must be positive");
+  }
+  self->__nx = nx;
+  self->__ny = ny;
+  self->__staged = true;
+  return 0;
+}
@@ -0,0 +1,296 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * StreamlineSource: the field lines of a 3d vector DataSource through a set of
+ * seed points, as line segments for a SegmentsEnsemble.
+ *
+ * NOTES:
+ *
+ * The input has shape (N0,N1,N2,3), whose last axis holds the x, y and z
+ * components of the field. Like the volume of VolumeRendering, the grid fills
+ * the unit cube centered on the origin, with x along its last axis and z along
+ * its first. The seeds are the rows of an (Ns,3) DataSource of positions in
+ * the same space, such as a PointsSource.
+ *
+ * The lines are parameterized by arc length, integrating the unit tangent of
+ * the trilinearly interpolated field with the classical fourth order Runge
+ * Kutta scheme. The step is adapted by step doubling: each step is also taken
+ * as two of half the size, and the difference of the two estimates kept below
+ * the tolerance. Steps never exceed the spacing of the grid, so that no cell
+ * is stepped over entirely. A line ends where it leaves the grid, where the
+ * field vanishes, or at the maximum length or number of steps.
+ *
+ * Seeds are traced in parallel, each into its own buffer, and the buffers are
+ * then joined.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "luview.hpp"
+#include "trilinear.hpp"
+
+static const char *TraceDirections[] = { "forward", "backward", "both", NULL };
+enum { TRACE_FORWARD, TRACE_BACKWARD, TRACE_BOTH };
+
+struct VectorField
+{
+  const GLfloat *f;
+  int N[3];
+} ;
+
+
+static bool tangent(const VectorField &F, const double *x, double sign,
+                    double *t)
+// -----------------------------------------------------------------------------
+// Writes the unit tangent of the field at x, times sign. Returns false if x is
+// outside the grid or the field vanishes there.
+// -----------------------------------------------------------------------------
+{
+  if (fabs(x[0]) > 0.5 || fabs(x[1]) > 0.5 || fabs(x[2]) > 0.5) return false;
+
+  double v[3];
+  trilinear(F.f, F.N, 3, (x[2] + 0.5)*F.N[0] - 0.5, (x[1] + 0.5)*F.N[1] - 0.5,
+            (x[0] + 0.5)*F.N[2] - 0.5, v);
+  const double norm = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+  if (norm < 1e-12) return false;
+  for (int d=0; d<3; ++d) t[d] = sign * v[d] / norm;
+  return true;
+}
+
+static bool rk4(const VectorField &F, const double *x, double h, double sign,
+                double *y)
+{
+  double k1[3], k2[3], k3[3], k4[3], z[3];
+  if (!tangent(F, x, sign, k1)) return false;
+  for (int d=0; d<3; ++d) z[d] = x[d] + 0.5*h*k1[d];
+  if (!tangent(F, z, sign, k2)) return false;
+  for (int d=0; d<3; ++d) z[d] = x[d] + 0.5*h*k2[d];
+  if (!tangent(F, z, sign, k3)) return false;
+  for (int d=0; d<3; ++d) z[d] = x[d] + h*k3[d];
+  if (!tangent(F, z, sign, k4)) return false;
+  for (int d=0; d<3; ++d) {
+    y[d] = x[d] + h/6.0 * (k1[d] + 2*k2[d] + 2*k3[d] + k4[d]);
+  }
+  return true;
+}
+
+static void trace(const VectorField &F, const double *seed, double sign,
+                  double hmax, double tol, double max_length, int max_steps,
+                  std::vector<GLfloat> &line)
+// -----------------------------------------------------------------------------
+// Appends to `line` the points after `seed` along the field, times sign.
+// -----------------------------------------------------------------------------
+{
+  const double hmin = 1e-3 * hmax;
+  double x[3] = { seed[0], seed[1], seed[2] };
+  double h = hmax;
+  double length = 0.0;
+
+  for (int n=0; n<max_steps && length < max_length; ++n) {
+    double y1[3], y2[3], ym[3];
+    bool accepted = false;
+
+    while (!accepted) {
+      h = std::min(h, max_length - length);
+      if (!rk4(F, x, h, sign, y1) ||
+          !rk4(F, x, 0.5*h, sign, ym) ||
+          !rk4(F, ym, 0.5*h, sign, y2)) {
+        if (h <= hmin) return; // reached the edge of the grid, or a null
+        h = std::max(0.5*h, hmin);
+        continue;
+      }
+      const double err = sqrt((y2[0] - y1[0])*(y2[0] - y1[0]) +
+                              (y2[1] - y1[1])*(y2[1] - y1[1]) +
+                              (y2[2] - y1[2])*(y2[2] - y1[2]));
+      if (err > tol && h > hmin) {
+        h = std::max(h * std::max(0.9*pow(tol / err, 0.2), 0.2), hmin);
+        continue;
+      }
+      accepted = true;
+      for (int d=0; d<3; ++d) {
+        x[d] = y2[d] + (y2[d] - y1[d]) / 15.0; // Richardson extrapolation
+        line.push_back(x[d]);
+      }
+      length += h;
+      const double grow = err > 0.0 ? 0.9*pow(tol / err, 0.2) : 2.0;
+      h = std::min(h * std::min(grow, 2.0), hmax);
+    }
+  }
+}
+
+
+StreamlineSource::StreamlineSource()
+  : __seeds(NULL),
+    __seeds_version(-1),
+    __direction(TRACE_BOTH),
+    __tolerance(1e-5),
+    __max_length(2.0),
+    __max_steps(2000)
+{
+
+}
+bool StreamlineSource::__side_inputs_changed()
+{
+  if (DataSource::__side_inputs_changed()) return true;
+  if (__seeds == NULL) return false;
+  __seeds->compile();
+  return __seeds->get_version() != __seeds_version;
+}
+
+void StreamlineSource::__refresh_cpu()
+{
+  if (__input_ds == NULL) {
+    luaL_error(__lua_state, "need an input data source\n");
+  }
+  if (__seeds == NULL) {
+    luaL_error(__lua_state, "need a seeds data source\n");
+  }
+  std::string tname = _get_type();
+  __input_ds->check_has_data(tname.c_str());
+  __input_ds->check_num_dimensions(tname.c_str(), 4);
+  __input_ds->check_num_points(tname.c_str(), 3, 3);
+  __seeds->check_has_data("seeds");
+  __seeds->check_num_dimensions("seeds", 2);
+  __seeds->check_num_points("seeds", 3, 1);
+
+  VectorField F;
+  F.f = __input_ds->get_data();
+  for (int d=0; d<3; ++d) F.N[d] = __input_ds->get_num_points(d);
+
+  const int Ns = __seeds->get_num_points(0);
+  const GLfloat *seeds = __seeds->get_data();
+  const double hmax = 1.0 / std::max(F.N[0], std::max(F.N[1], F.N[2]));
+  std::vector<std::vector<GLfloat> > back(Ns), fore(Ns);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int n=0; n<Ns; ++n) {
+    const double x[3] = { seeds[3*n + 0], seeds[3*n + 1], seeds[3*n + 2] };
+    if (__direction != TRACE_FORWARD) {
+      trace(F, x, -1.0, hmax, __tolerance, __max_length, __max_steps, back[n]);
+    }
+    if (__direction != TRACE_BACKWARD) {
+      trace(F, x, +1.0, hmax, __tolerance, __max_length, __max_steps, fore[n]);
+    }
+  }
+
+  // Each line is its backward half reversed, the seed, and its forward half.
+  std::vector<int> start(Ns + 1, 0);
+  for (int n=0; n<Ns; ++n) {
+    start[n + 1] = start[n] + (back[n].size() + fore[n].size()) / 3 + 1;
+  }
+  const int Np = start[Ns];
+  const int Nl = Np - Ns; // number of segments
+
+  // The outputs must never be empty, so without segments there is a single
+  // degenerate one.
+  std::vector<GLfloat> verts(3*std::max(Np, 1), 0.0);
+  std::vector<GLuint> indices(2*std::max(Nl, 1), 0);
+
+#pragma omp parallel for schedule(dynamic)
+  for (int n=0; n<Ns; ++n) {
+    GLfloat *v = &verts[3*start[n]];
+    const int nb = back[n].size() / 3;
+    for (int m=nb-1; m>=0; --m) {
+      for (int d=0; d<3; ++d) *v++ = back[n][3*m + d];
+    }
+    for (int d=0; d<3; ++d) *v++ = seeds[3*n + d];
+    std::copy(fore[n].begin(), fore[n].end(), v);
+
+    GLuint *s = &indices[0] + 2*(start[n] - n);
+    for (int m=start[n]; m<start[n + 1] - 1; ++m) {
+      *s++ = m;
+      *s++ = m + 1;
+    }
+  }
+
+  __cpu_data = (GLfloat*) realloc(__cpu_data, verts.size()*sizeof(GLfloat));
+  std::copy(verts.begin(), verts.end(), __cpu_data);
+  __num_dimensions = 2;
+  __num_points[0] = verts.size() / 3;
+  __num_points[1] = 3;
+  set_indices(&indices[0], indices.size());
+  __seeds_version = __seeds->get_version();
+}
+
+
+StreamlineSource::LuaInstanceMethod
+StreamlineSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["set_seeds"] = _set_seeds_;
+  attr["get_direction"] = _get_direction_;
+  attr["set_direction"] = _set_direction_;
+  attr["get_tolerance"] = _get_tolerance_;
+  attr["set_tolerance"] = _set_tolerance_;
+  attr["get_max_length"] = _get_max_length_;
+  attr["set_max_length"] = _set_max_length_;
+  attr["get_max_steps"] = _get_max_steps_;
+  attr["set_max_steps"] = _set_max_steps_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int StreamlineSource::_set_seeds_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  self->__seeds = self->replace(self->__seeds, 2);
+  self->__seeds_version = -1;
+  self->__staged = true;
+  return 0;
+}
+int StreamlineSource::_get_direction_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  lua_pushstring(L, TraceDirections[self->__direction]);
+  return 1;
+}
+int StreamlineSource::_set_direction_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  self->__direction = luaL_checkoption(L, 2, NULL, TraceDirections);
+  self->__staged = true;
+  return 0;
+}
+int StreamlineSource::_get_tolerance_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  lua_pushnumber(L, self->__tolerance);
+  return 1;
+}
+int StreamlineSource::_set_tolerance_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  const double tol = luaL_checknumber(L, 2);
+  if (tol <= 0.0) {
+    luaL_error(L, "tolerance must be positive");
+  }
+  self->__tolerance = tol;
+  self->__staged = true;
+  return 0;
+}
+int StreamlineSource::_get_max_length_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  lua_pushnumber(L, self->__max_length);
+  return 1;
+}
+int StreamlineSource::_set_max_length_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  self->__max_length = luaL_checknumber(L, 2);
+  self->__staged = true;
+  return 0;
+}
+int StreamlineSource::_get_max_steps_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  lua_pushnumber(L, self->__max_steps);
+  return 1;
+}
+int StreamlineSource::_set_max_steps_(lua_State *L)
+{
+  StreamlineSource *self = checkarg<StreamlineSource>(L, 1);
+  self->__max_steps = luaL_checkinteger(L, 2);
+  self->__staged = true;
+  return 0;
+}
@@ -0,0 +1,582 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * TerrainSurface: draws the "mesh" output of a ParametricVertexSource3D with a
+ * level of detail chosen per chunk of the grid, so that the number of triangles
+ * drawn stays bounded however large the height field is.
+ *
+ * NOTES:
+ *
+ * The grid is covered by a quadtree of chunks. Each chunk has the same number
+ * of quads along its side, but a chunk on level L samples every 2^L'th vertex.
+ * The vertices themselves are those of the mesh's own vertex buffer, so the
+ * chunks on one level all share an index pattern, and are drawn by pointing
+ * the vertex arrays at their corner. Chunks clipped by the edge of the grid
+ * get their own indices, as do the triangles filling the cracks between
+ * neighboring chunks of different levels.
+ *
+ * Every frame the quadtree is refined from the root, always splitting the
+ * chunk with the largest screen-space error first, until all chunks are within
+ * the tolerance or the triangle budget is spent. The error of a chunk is the
+ * largest height difference between the full resolution grid and the chunk's
+ * coarser one, projected to the screen at the chunk's nearest distance.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <queue>
+#include <algorithm>
+#include "luview.hpp"
+
+enum { CHUNK_NONE, CHUNK_SPLIT, CHUNK_LEAF };
+
+
+static void point_streams(GLuint vbo, GLuint base)
+// -----------------------------------------------------------------------------
+// Points the interleaved mesh attributes at vertex `base` of `vbo`.
+// -----------------------------------------------------------------------------
+{
+  const GLsizei stride = __MESH_STRIDE*sizeof(GLfloat);
+  const size_t offset = (size_t) base*stride;
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glVertexPointer(3, GL_FLOAT, stride, (GLvoid*) (offset));
+  glNormalPointer(GL_FLOAT, stride, (GLvoid*) (offset + 3*sizeof(GLfloat)));
+  glTexCoordPointer(1, GL_FLOAT, stride, (GLvoid*) (offset + 6*sizeof(GLfloat)));
+}
+
+
+TerrainSurface::TerrainSurface()
+  : chunk(32),
+    num_levels(0),
+    grid_Nu(0),
+    grid_Nv(0),
+    pattern_Nv(0),
+    tolerance(2.0),
+    budget(1<<20),
+    num_drawn(0),
+    num_culled(0),
+    built_source(NULL),
+    built_version(-1)
+{
+  gl_modes.push_back(GL_DEPTH_TEST);
+  gl_modes.push_back(GL_LIGHTING);
+  gl_modes.push_back(GL_LIGHT0);
+  gl_modes.push_back(GL_BLEND);
+  gl_modes.push_back(GL_COLOR_MATERIAL);
+  gl_modes.push_back(GL_NORMALIZE);
+  glGenBuffers(1, &extra_ibo);
+}
+TerrainSurface::~TerrainSurface()
+{
+  if (!patterns.empty()) glDeleteBuffers(patterns.size(), &patterns[0]);
+  glDeleteBuffers(1, &extra_ibo);
+}
+
+int TerrainSurface::levels_across(int level) const
+{
+  return 1 << (num_levels - 1 - level);
+}
+bool TerrainSurface::is_empty(int level, int a, int b) const
+{
+  const int span = chunk << level;
+  return a*span >= grid_Nu - 1 || b*span >= grid_Nv - 1;
+}
+GLuint TerrainSurface::vertex(int i, int j) const
+{
+  return std::min(i, grid_Nu - 1)*grid_Nv + std::min(j, grid_Nv - 1);
+}
+
+void TerrainSurface::build_tree(const GLfloat *verts)
+// -----------------------------------------------------------------------------
+// Finds the height range and geometric error of every chunk, in parallel over
+// the chunks of each level. The error of a chunk is made at least that of its
+// children, so that refinement never stops above a chunk which needs it.
+// -----------------------------------------------------------------------------
+{
+  const int Nu = grid_Nu;
+  const int Nv = grid_Nv;
+  const int n = std::max(Nu, Nv) - 1;
+
+  num_levels = 1;
+  while ((chunk << (num_levels - 1)) < n) ++num_levels;
+
+  errors.resize(num_levels);
+  zmin.resize(num_levels);
+  zmax.resize(num_levels);
+  state.resize(num_levels);
+
+  for (int L=0; L<num_levels; ++L) {
+    const int s = 1 << L;
+    const int span = chunk << L;
+    const int nL = levels_across(L);
+    errors[L].assign(nL*nL, 0.0);
+    zmin[L].assign(nL*nL, 0.0);
+    zmax[L].assign(nL*nL, 0.0);
+    state[L].assign(nL*nL, (char) CHUNK_NONE);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int k=0; k<nL*nL; ++k) {
+      const int a = k / nL;
+      const int b = k % nL;
+      if (is_empty(L, a, b)) continue;
+
+      const int i0 = a*span, i1 = std::min(i0 + span, Nu - 1);
+      const int j0 = b*span, j1 = std::min(j0 + span, Nv - 1);
+      double err = 0.0, lo = 1e16, hi = -1e16;
+
+      for (int ci=i0; ci<i1; ci+=s) {
+        const int ci1 = std::min(ci + s, i1);
+        for (int cj=j0; cj<j1; cj+=s) {
+          const int cj1 = std::min(cj + s, j1);
+          const double z00 = verts[__MESH_STRIDE*(ci *Nv + cj ) + 2];
+          const double z01 = verts[__MESH_STRIDE*(ci *Nv + cj1) + 2];
+          const double z10 = verts[__MESH_STRIDE*(ci1*Nv + cj ) + 2];
+          const double z11 = verts[__MESH_STRIDE*(ci1*Nv + cj1) + 2];
+
+          for (int i=ci; i<=ci1; ++i) {
+            const double t = double(i - ci) / (ci1 - ci);
+            for (int j=cj; j<=cj1; ++j) {
+              const double u = double(j - cj) / (cj1 - cj);
+              const double z = verts[__MESH_STRIDE*(i*Nv + j) + 2];
+              const double zc =
+                (1-t)*((1-u)*z00 + u*z01) + t*((1-u)*z10 + u*z11);
+              err = std::max(err, fabs(z - zc));
+              lo = std::min(lo, z);
+              hi = std::max(hi, z);
+            }
+          }
+        }
+      }
+      errors[L][k] = err;
+      zmin[L][k] = lo;
+      zmax[L][k] = hi;
+    }
+
+    if (L == 0) continue;
+    const int nC = levels_across(L - 1);
+    for (int k=0; k<nL*nL; ++k) {
+      const int a = k / nL;
+      const int b = k % nL;
+      for (int c=0; c<4; ++c) {
+        const int ca = 2*a + c/2;
+        const int cb = 2*b + c%2;
+        if (ca < nC && cb < nC && !is_empty(L - 1, ca, cb)) {
+          errors[L][k] = std::max(errors[L][k], errors[L-1][ca*nC + cb]);
+        }
+      }
+    }
+  }
+}
+
+void TerrainSurface::build_patterns()
+// -----------------------------------------------------------------------------
+// Builds the indices of an unclipped chunk on each level, relative to its
+// corner vertex. The triangles are wound as those of ParametricVertexSource3D.
+// -----------------------------------------------------------------------------
+{
+  if (!patterns.empty()) glDeleteBuffers(patterns.size(), &patterns[0]);
+  patterns.resize(num_levels);
+  glGenBuffers(num_levels, &patterns[0]);
+
+  const int Nv = grid_Nv;
+  std::vector<GLuint> ind(6*chunk*chunk);
+
+  for (int L=0; L<num_levels; ++L) {
+    const GLuint s = 1 << L;
+    for (int p=0; p<chunk; ++p) {
+      for (int q=0; q<chunk; ++q) {
+        GLuint *t = &ind[6*(p*chunk + q)];
+        t[0] = (p  )*s*Nv + (q+1)*s;
+        t[1] = (p  )*s*Nv + (q  )*s;
+        t[2] = (p+1)*s*Nv + (q  )*s;
+        t[3] = (p  )*s*Nv + (q+1)*s;
+        t[4] = (p+1)*s*Nv + (q  )*s;
+        t[5] = (p+1)*s*Nv + (q+1)*s;
+      }
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patterns[L]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, ind.size()*sizeof(GLuint), &ind[0],
+                 GL_STATIC_DRAW);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  pattern_Nv = Nv;
+}
+
+void TerrainSurface::chunk_bounds(const GLfloat *verts, int level, int a, int b,
+                                  double *lo, double *hi)
+{
+  const int nL = levels_across(level);
+  const int span = chunk << level;
+  const int i0 = a*span, i1 = std::min(i0 + span, grid_Nu - 1);
+  const int j0 = b*span, j1 = std::min(j0 + span, grid_Nv - 1);
+  const GLfloat *p0 = &verts[__MESH_STRIDE*vertex(i0, j0)];
+  const GLfloat *p1 = &verts[__MESH_STRIDE*vertex(i1, j1)];
+
+  for (int d=0; d<2; ++d) {
+    lo[d] = std::min(p0[d], p1[d]);
+    hi[d] = std::max(p0[d], p1[d]);
+  }
+  lo[2] = zmin[level][a*nL + b];
+  hi[2] = zmax[level][a*nL + b];
+}
+
+double TerrainSurface::screen_error(int level, int a, int b, const double *lo,
+                                    const double *hi, const double *M,
+                                    const double *P, const double *V)
+// -----------------------------------------------------------------------------
+// Projects the geometric error of a chunk with bounds lo, hi to pixels, using
+// the current modelview matrix M, projection P and viewport V. The distance is
+// taken to the nearest point of the chunk's bounding sphere.
+// -----------------------------------------------------------------------------
+{
+  const int nL = levels_across(level);
+  double c[3], h[3], e[3], col[3];
+
+  for (int k=0; k<3; ++k) {
+    c[k] = 0.5*(lo[k] + hi[k]);
+    h[k] = 0.5*(hi[k] - lo[k]);
+  }
+  for (int k=0; k<3; ++k) {
+    e[k] = M[k]*c[0] + M[4+k]*c[1] + M[8+k]*c[2] + M[12+k];
+    col[k] = sqrt(M[4*k]*M[4*k] + M[4*k+1]*M[4*k+1] + M[4*k+2]*M[4*k+2]);
+  }
+  const double err = errors[level][a*nL + b] * col[2];
+  const double pixels = 0.5 * V[3] * P[5];
+
+  if (err == 0.0) return 0.0;
+  if (P[11] == 0.0) return err * pixels; // orthographic projection
+
+  const double r = sqrt(h[0]*h[0]*col[0]*col[0] +
+                        h[1]*h[1]*col[1]*col[1] +
+                        h[2]*h[2]*col[2]*col[2]);
+  const double d = sqrt(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]) - r;
+  return err * pixels / (d > 1e-6 ? d : 1e-6);
+}
+
+void TerrainSurface::select_chunks(const GLfloat *verts,
+                                   std::vector<Chunk> &cut)
+// -----------------------------------------------------------------------------
+// Refines the quadtree from its root, splitting the chunk with the largest
+// screen-space error first, and returns the chunks to be drawn in `cut`.
+// Chunks outside the view frustum are neither refined nor drawn, and do not
+// count against the budget.
+// -----------------------------------------------------------------------------
+{
+  GLdouble M[16], P[16], PM[16];
+  GLint viewport[4];
+  glGetDoublev(GL_MODELVIEW_MATRIX, M);
+  glGetDoublev(GL_PROJECTION_MATRIX, P);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  const double V[4] = { double(viewport[0]), double(viewport[1]),
+                        double(viewport[2]), double(viewport[3]) };
+  ViewFrustum::multiply(P, M, PM);
+  const ViewFrustum frustum(PM);
+
+  for (int L=0; L<num_levels; ++L) {
+    state[L].assign(state[L].size(), (char) CHUNK_NONE);
+  }
+
+  const int cost = 2*chunk*chunk;
+  std::priority_queue<Chunk> queue;
+  int used = 0;
+  cut.clear();
+  num_culled = 0;
+
+  // Chunks waiting to be culled and measured, starting with the root.
+  Chunk root = { num_levels - 1, 0, 0, 0.0 };
+  std::vector<Chunk> next(1, root);
+
+  while (true) {
+    for (unsigned int n=0; n<next.size(); ++n) {
+      Chunk &d = next[n];
+      double lo[3], hi[3];
+      chunk_bounds(verts, d.level, d.a, d.b, lo, hi);
+      if (frustum.intersects(lo, hi)) {
+        d.error = screen_error(d.level, d.a, d.b, lo, hi, M, P, V);
+        queue.push(d);
+        used += cost;
+      }
+      else {
+        state[d.level][d.a*levels_across(d.level) + d.b] = CHUNK_LEAF;
+        ++num_culled;
+      }
+    }
+    next.clear();
+    if (queue.empty()) break;
+
+    const Chunk c = queue.top();
+    queue.pop();
+    const int nL = levels_across(c.level);
+    int nc = 0;
+
+    if (c.level > 0 && c.error > tolerance) {
+      const int nC = levels_across(c.level - 1);
+      for (int k=0; k<4; ++k) {
+        const int ca = 2*c.a + k/2;
+        const int cb = 2*c.b + k%2;
+        if (ca < nC && cb < nC && !is_empty(c.level - 1, ca, cb)) ++nc;
+      }
+    }
+    if (nc > 0 && used + (nc - 1)*cost <= budget) {
+      const int nC = levels_across(c.level - 1);
+      state[c.level][c.a*nL + c.b] = CHUNK_SPLIT;
+      used -= cost;
+      for (int k=0; k<4; ++k) {
+        Chunk d = { c.level - 1, 2*c.a + k/2, 2*c.b + k%2, 0.0 };
+        if (d.a < nC && d.b < nC && !is_empty(d.level, d.a, d.b)) {
+          next.push_back(d);
+        }
+      }
+    }
+    else {
+      state[c.level][c.a*nL + c.b] = CHUNK_LEAF;
+      cut.push_back(c);
+    }
+  }
+}
+
+void TerrainSurface::emit_clipped(const Chunk &c)
+// -----------------------------------------------------------------------------
+// Appends the indices of a chunk which reaches past the edge of the grid. Its
+// last row and column of quads are narrower than the others.
+// -----------------------------------------------------------------------------
+{
+  const int s = 1 << c.level;
+  const int span = chunk << c.level;
+  const int i0 = c.a*span, i1 = std::min(i0 + span, grid_Nu - 1);
+  const int j0 = c.b*span, j1 = std::min(j0 + span, grid_Nv - 1);
+  std::vector<int> ri, rj;
+
+  for (int i=i0; i<i1; i+=s) ri.push_back(i);
+  for (int j=j0; j<j1; j+=s) rj.push_back(j);
+  ri.push_back(i1);
+  rj.push_back(j1);
+
+  for (unsigned int p=0; p+1<ri.size(); ++p) {
+    for (unsigned int q=0; q+1<rj.size(); ++q) {
+      extra.push_back(vertex(ri[p  ], rj[q+1]));
+      extra.push_back(vertex(ri[p  ], rj[q  ]));
+      extra.push_back(vertex(ri[p+1], rj[q  ]));
+      extra.push_back(vertex(ri[p  ], rj[q+1]));
+      extra.push_back(vertex(ri[p+1], rj[q  ]));
+      extra.push_back(vertex(ri[p+1], rj[q+1]));
+    }
+  }
+}
+
+void TerrainSurface::emit_stitches(const Chunk &c)
+// -----------------------------------------------------------------------------
+// Appends triangles closing the cracks along each side of the chunk which
+// borders a coarser one. Each coarse edge is joined to the finer vertices
+// along it by a fan from its first vertex. Sides bordering finer chunks are
+// left to those chunks.
+// -----------------------------------------------------------------------------
+{
+  const int s = 1 << c.level;
+  const int span = chunk << c.level;
+  const int i0 = c.a*span, i1 = std::min(i0 + span, grid_Nu - 1);
+  const int j0 = c.b*span, j1 = std::min(j0 + span, grid_Nv - 1);
+  const int nL = levels_across(c.level);
+  const int da[4] = { -1, +1,  0,  0 };
+  const int db[4] = {  0,  0, -1, +1 };
+
+  for (int side=0; side<4; ++side) {
+    int na = c.a + da[side];
+    int nb = c.b + db[side];
+    if (na < 0 || nb < 0 || na >= nL || nb >= nL ||
+        is_empty(c.level, na, nb)) continue;
+
+    int level = c.level;
+    while (level < num_levels &&
+           state[level][na*levels_across(level) + nb] == CHUNK_NONE) {
+      na >>= 1;
+      nb >>= 1;
+      ++level;
+    }
+    if (level == c.level || level == num_levels) continue;
+
+    // The side runs along j at fixed i for the first two, and vice versa.
+    const bool along_j = side < 2;
+    const int fixed = side == 0 ? i0 : side == 1 ? i1 : side == 2 ? j0 : j1;
+    const int r0 = along_j ? j0 : i0;
+    const int r1 = along_j ? j1 : i1;
+    const int end = along_j ? grid_Nv - 1 : grid_Nu - 1;
+    const int S = 1 << level;
+
+    for (int cs=r0 - r0 % S; cs<r1; cs+=S) {
+      const int ce = std::min(cs + S, end);
+      std::vector<int> pts;
+      for (int f=cs + s; f<ce; f+=s) {
+        if (f >= r0 && f <= r1) pts.push_back(f);
+      }
+      if (pts.empty()) continue;
+      pts.push_back(ce);
+
+      const GLuint apex = along_j ? vertex(fixed, cs) : vertex(cs, fixed);
+      for (unsigned int k=0; k+1<pts.size(); ++k) {
+        extra.push_back(apex);
+        extra.push_back(along_j ? vertex(fixed, pts[k]) : vertex(pts[k], fixed));
+        extra.push_back(along_j ? vertex(fixed, pts[k+1]) :
+                        vertex(pts[k+1], fixed));
+      }
+    }
+  }
+}
+
+void TerrainSurface::draw_local()
+{
+  EntryDS msh = DataSources.find("mesh");
+  EntryDS lut = DataSources.find("color_table");
+
+  if (msh == DataSources.end()) return;
+  if (shader) {
+    shader->set_uniform("tex1d", 0);
+  }
+
+  MeshSource *mesh = dynamic_cast<MeshSource*>(msh->second);
+  if (mesh == NULL) {
+    luaL_error(__lua_state, "TerrainSurface needs the \"mesh\" output of a "
+               "ParametricVertexSource3D");
+  }
+  mesh->compile();
+  mesh->check_has_data("mesh");
+  mesh->check_num_dimensions("mesh", 2);
+  mesh->check_num_points("mesh", __MESH_STRIDE, 1);
+  if (mesh->get_grid_shape(0) < 2 || mesh->get_grid_shape(1) < 2) {
+    luaL_error(__lua_state, "the mesh given to TerrainSurface is not a grid");
+  }
+
+  if (lut != DataSources.end()) {
+    glActiveTexture(GL_TEXTURE0 + 0);
+    lut->second->compile();
+    lut->second->check_has_data("color_table");
+    lut->second->check_num_dimensions("color_table", 2);
+    lut->second->check_num_points("color_table", 256, 0);
+    lut->second->check_num_points("color_table", 4, 1);
+    lut->second->become_texture();
+  }
+
+  const GLfloat *verts = mesh->get_data();
+  if (built_source != mesh || built_version != mesh->get_version() ||
+      grid_Nu != mesh->get_grid_shape(0) ||
+      grid_Nv != mesh->get_grid_shape(1)) {
+    grid_Nu = mesh->get_grid_shape(0);
+    grid_Nv = mesh->get_grid_shape(1);
+    build_tree(verts);
+    built_source = mesh;
+    built_version = mesh->get_version();
+  }
+  if (pattern_Nv != grid_Nv || (int) patterns.size() != num_levels) {
+    build_patterns();
+  }
+
+  std::vector<Chunk> cut;
+  select_chunks(verts, cut);
+  extra.clear();
+  num_drawn = 0;
+
+  const GLuint vbo = mesh->get_vbo();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+  for (unsigned int n=0; n<cut.size(); ++n) {
+    const Chunk &c = cut[n];
+    const int span = chunk << c.level;
+    const int i0 = c.a*span;
+    const int j0 = c.b*span;
+
+    if (i0 + span > grid_Nu - 1 || j0 + span > grid_Nv - 1) {
+      emit_clipped(c);
+    }
+    else {
+      point_streams(vbo, vertex(i0, j0));
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, patterns[c.level]);
+      glDrawElements(GL_TRIANGLES, 6*chunk*chunk, GL_UNSIGNED_INT, 0);
+      num_drawn += 2*chunk*chunk;
+    }
+    emit_stitches(c);
+  }
+
+  if (!extra.empty()) {
+    point_streams(vbo, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, extra_ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, extra.size()*sizeof(GLuint),
+                 &extra[0], GL_STREAM_DRAW);
+    glDrawElements(GL_TRIANGLES, extra.size(), GL_UNSIGNED_INT, 0);
+    num_drawn += extra.size() / 3;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+
+TerrainSurface::LuaInstanceMethod
+TerrainSurface::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_tolerance"] = _get_tolerance_;
+  attr["set_tolerance"] = _set_tolerance_;
+  attr["get_budget"] = _get_budget_;
+  attr["set_budget"] = _set_budget_;
+  attr["set_chunk_size"] = _set_chunk_size_;
+  attr["get_num_triangles"] = _get_num_triangles_;
+  attr["get_num_culled"] = _get_num_culled_;
+  RETURN_ATTR_OR_CALL_SUPER(DrawableObject);
+}
+int TerrainSurface::_get_tolerance_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  lua_pushnumber(L, self->tolerance);
+  return 1;
+}
+int TerrainSurface::_set_tolerance_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  self->tolerance = luaL_checknumber(L, 2);
+  ++self->Revision;
+  return 0;
+}
+int TerrainSurface::_get_budget_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  lua_pushnumber(L, self->budget);
+  return 1;
+}
+int TerrainSurface::_set_budget_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  self->budget = luaL_checkinteger(L, 2);
+  ++self->Revision;
+  return 0;
+}
+int TerrainSurface::_set_chunk_size_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  const int n = luaL_checkinteger(L, 2);
+  if (n < 1) {
+    luaL_error(L, "chunk size must be positive");
+  }
+  self->chunk = n;
+  self->built_source = NULL; // rebuild the tree and the patterns
+  self->pattern_Nv = 0;
+  ++self->Revision;
+  return 0;
+}
+int TerrainSurface::_get_num_triangles_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  lua_pushnumber(L, self->num_drawn);
+  return 1;
+}
+int TerrainSurface::_get_num_culled_(lua_State *L)
+{
+  TerrainSurface *self = checkarg<TerrainSurface>(L, 1);
+  lua_pushnumber(L, self->num_culled);
+  return 1;
+}
@@ -0,0 +1,355 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * TimeSeriesSource: a DataSource which steps through a list of HDF5 datasets,
+ * e.g. the same field in a sequence of checkpoint files. Frames within a window
+ * around the current one are read ahead of time by a background loader thread,
+ * so that changing frames only swaps the decoded buffer into place.
+ *
+ * NOTES:
+ *
+ * The HDF5 library is not thread safe unless it was built so. All reads made by
+ * the loaders go through h5_lock, but the loaders are not synchronized with the
+ * hdf5 Lua module, so scripts should not read from the same files with it
+ * while frames are still being prefetched.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <hdf5.h>
+#include "luview.hpp"
+
+
+enum { FRAME_EMPTY, FRAME_LOADING, FRAME_READY, FRAME_RESIDENT, FRAME_FAILED };
+static pthread_mutex_t h5_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static GLfloat *read_dataset(const char *fname, const char *dset, int *np,
+                             int *nd)
+// -----------------------------------------------------------------------------
+// Reads the dataset `dset` from the file `fname` as single precision, and
+// returns a malloc'd buffer or NULL on failure. May be called from any thread.
+// -----------------------------------------------------------------------------
+{
+  GLfloat *data = NULL;
+  pthread_mutex_lock(&h5_lock);
+
+  hid_t file = H5Fopen(fname, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file >= 0) {
+    hid_t set = H5Dopen(file, dset, H5P_DEFAULT);
+    if (set >= 0) {
+      hid_t spc = H5Dget_space(set);
+      int ndims = H5Sget_simple_extent_ndims(spc);
+      if (ndims > 0 && ndims <= __DATASOURCE_MAXDIMS) {
+        hsize_t dims[__DATASOURCE_MAXDIMS];
+        size_t N = 1;
+        H5Sget_simple_extent_dims(spc, dims, NULL);
+        for (int i=0; i<ndims; ++i) {
+          np[i] = dims[i];
+          N *= dims[i];
+        }
+        *nd = ndims;
+        data = (GLfloat*) malloc(N*sizeof(GLfloat));
+        if (H5Dread(set, H5T_NATIVE_FLOAT, H5S_ALL, H5S_ALL, H5P_DEFAULT,
+                    data) < 0) {
+          free(data);
+          data = NULL;
+        }
+      }
+      H5Sclose(spc);
+      H5Dclose(set);
+    }
+    H5Fclose(file);
+  }
+
+  pthread_mutex_unlock(&h5_lock);
+  return data;
+}
+
+
+TimeSeriesSource::TimeSeriesSource()
+  : __current(0),
+    __resident(-1),
+    __resident_normalized(false),
+    __behind(1),
+    __ahead(2),
+    __shutdown(false)
+{
+  pthread_mutex_init(&__lock, NULL);
+  pthread_cond_init(&__wake, NULL);
+  pthread_cond_init(&__loaded, NULL);
+  pthread_create(&__loader, NULL, __loader_main, this);
+}
+
+TimeSeriesSource::~TimeSeriesSource()
+{
+  pthread_mutex_lock(&__lock);
+  __shutdown = true;
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__lock);
+  pthread_join(__loader, NULL);
+
+  for (unsigned int n=0; n<__frames.size(); ++n) {
+    if (__frames[n].data) free(__frames[n].data);
+  }
+  pthread_cond_destroy(&__loaded);
+  pthread_cond_destroy(&__wake);
+  pthread_mutex_destroy(&__lock);
+}
+
+void TimeSeriesSource::add_frame(const char *fname, const char *dset)
+{
+  Frame f;
+  f.fname = fname;
+  f.dset = dset;
+  f.data = NULL;
+  f.num_dimensions = 0;
+  f.status = FRAME_EMPTY;
+
+  pthread_mutex_lock(&__lock);
+  __frames.push_back(f);
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__lock);
+  if (__frames.size() == 1) __staged = true;
+}
+void TimeSeriesSource::set_frame(int n)
+{
+  if (n < 0 || n >= get_num_frames()) {
+    luaL_error(__lua_state, "frame %d out of range [0, %d)", n,
+               get_num_frames());
+  }
+  pthread_mutex_lock(&__lock);
+  __current = n;
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__lock);
+  __staged = true;
+}
+void TimeSeriesSource::set_window(int behind, int ahead)
+{
+  pthread_mutex_lock(&__lock);
+  __behind = behind < 0 ? 0 : behind;
+  __ahead = ahead < 0 ? 0 : ahead;
+  __evict();
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__lock);
+}
+int TimeSeriesSource::get_num_frames()
+{
+  pthread_mutex_lock(&__lock);
+  int N = __frames.size();
+  pthread_mutex_unlock(&__lock);
+  return N;
+}
+
+void TimeSeriesSource::__refresh_cpu()
+// -----------------------------------------------------------------------------
+// Makes the current frame resident in __cpu_data. If it has been prefetched
+// this is only a swap of buffers, otherwise we wait for the loader to get to
+// it. The loader always reads the current frame first.
+// -----------------------------------------------------------------------------
+{
+  if (__frames.empty()) {
+    luaL_error(__lua_state, "TimeSeriesSource has no frames");
+  }
+  pthread_mutex_lock(&__lock);
+
+  // A buffer normalized in place no longer holds the frame's data, so the frame
+  // is read again once normalization has been turned off.
+  if (__resident == __current && __resident_normalized && !__normalize) {
+    __frames[__resident].status = FRAME_EMPTY;
+    free(__cpu_data);
+    __cpu_data = NULL;
+    __resident = -1;
+  }
+
+  if (__resident != __current) {
+    Frame &f = __frames[__current];
+    pthread_cond_signal(&__wake);
+    while (f.status == FRAME_EMPTY || f.status == FRAME_LOADING) {
+      pthread_cond_wait(&__loaded, &__lock);
+    }
+    if (f.status == FRAME_FAILED) {
+      pthread_mutex_unlock(&__lock);
+      luaL_error(__lua_state, "could not read dataset %s from %s",
+                 f.dset.c_str(), f.fname.c_str());
+    }
+
+    // The outgoing buffer may only go back into the cache if it has not been
+    // modified in place by normalization.
+    if (__resident != -1 && !__resident_normalized) {
+      Frame &r = __frames[__resident];
+      r.data = __cpu_data;
+      r.status = FRAME_READY;
+    }
+    else {
+      if (__resident != -1) __frames[__resident].status = FRAME_EMPTY;
+      free(__cpu_data);
+    }
+
+    __cpu_data = f.data;
+    __num_dimensions = f.num_dimensions;
+    for (int i=0; i<__DATASOURCE_MAXDIMS; ++i) {
+      __num_points[i] = i < f.num_dimensions ? f.num_points[i] : 0;
+    }
+    f.data = NULL;
+    f.status = FRAME_RESIDENT;
+    __resident = __current;
+  }
+  __resident_normalized = __normalize; // normalization follows every refresh
+
+  __evict();
+  pthread_cond_signal(&__wake);
+  pthread_mutex_unlock(&__lock);
+}
+
+bool TimeSeriesSource::__in_window(int n)
+{
+  return n >= __current - __behind && n <= __current + __ahead;
+}
+int TimeSeriesSource::__next_to_load()
+// -----------------------------------------------------------------------------
+// Returns the empty frame nearest to the current one within the prefetch
+// window, preferring frames ahead, or -1 if there is nothing to do. Must be
+// called with __lock held.
+// -----------------------------------------------------------------------------
+{
+  const int N = __frames.size();
+  const int reach = __behind > __ahead ? __behind : __ahead;
+  for (int d=0; d<=reach; ++d) {
+    const int ahead = __current + d;
+    const int behind = __current - d;
+    if (d <= __ahead && ahead < N && __frames[ahead].status == FRAME_EMPTY) {
+      return ahead;
+    }
+    if (d <= __behind && behind >= 0 &&
+        __frames[behind].status == FRAME_EMPTY) {
+      return behind;
+    }
+  }
+  return -1;
+}
+void TimeSeriesSource::__evict()
+// -----------------------------------------------------------------------------
+// Frees the decoded frames which have fallen outside the prefetch window. Must
+// be called with __lock held.
+// -----------------------------------------------------------------------------
+{
+  for (unsigned int n=0; n<__frames.size(); ++n) {
+    Frame &f = __frames[n];
+    if (f.status == FRAME_READY && !__in_window((int) n)) {
+      free(f.data);
+      f.data = NULL;
+      f.status = FRAME_EMPTY;
+    }
+  }
+}
+void *TimeSeriesSource::__loader_main(void *self)
+{
+  static_cast<TimeSeriesSource*>(self)->__loader_loop();
+  return NULL;
+}
+void TimeSeriesSource::__loader_loop()
+{
+  pthread_mutex_lock(&__lock);
+
+  while (!__shutdown) {
+    const int n = __next_to_load();
+    if (n == -1) {
+      pthread_cond_wait(&__wake, &__lock);
+      continue;
+    }
+    __frames[n].status = FRAME_LOADING;
+    std::string fname = __frames[n].fname;
+    std::string dset = __frames[n].dset;
+    int np[__DATASOURCE_MAXDIMS], nd = 0;
+
+    pthread_mutex_unlock(&__lock);
+    GLfloat *data = read_dataset(fname.c_str(), dset.c_str(), np, &nd);
+    pthread_mutex_lock(&__lock);
+
+    Frame &f = __frames[n];
+    if (data == NULL) {
+      f.status = FRAME_FAILED;
+    }
+    else if (!__in_window(n)) { // the window moved on while we were reading
+      free(data);
+      f.status = FRAME_EMPTY;
+    }
+    else {
+      f.data = data;
+      f.num_dimensions = nd;
+      for (int i=0; i<nd; ++i) f.num_points[i] = np[i];
+      f.status = FRAME_READY;
+    }
+    pthread_cond_broadcast(&__loaded);
+  }
+
+  pthread_mutex_unlock(&__lock);
+}
+
+
+TimeSeriesSource::LuaInstanceMethod
+TimeSeriesSource::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["add_frame"] = _add_frame_;
+  attr["get_frame"] = _get_frame_;
+  attr["set_frame"] = _set_frame_;
+  attr["next_frame"] = _next_frame_;
+  attr["prev_frame"] = _prev_frame_;
+  attr["set_window"] = _set_window_;
+  attr["get_num_frames"] = _get_num_frames_;
+  RETURN_ATTR_OR_CALL_SUPER(DataSource);
+}
+int TimeSeriesSource::_add_frame_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  const char *fname = luaL_checkstring(L, 2);
+  const char *dset = luaL_checkstring(L, 3);
+  self->add_frame(fname, dset);
+  return 0;
+}
+int TimeSeriesSource::_get_frame_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  lua_pushnumber(L, self->__current);
+  return 1;
+}
+int TimeSeriesSource::_set_frame_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  self->set_frame(luaL_checkinteger(L, 2));
+  return 0;
+}
+int TimeSeriesSource::_next_frame_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  if (self->__current + 1 < self->get_num_frames()) {
+    self->set_frame(self->__current + 1);
+  }
+  lua_pushnumber(L, self->__current);
+  return 1;
+}
+int TimeSeriesSource::_prev_frame_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  if (self->__current > 0) {
+    self->set_frame(self->__current - 1);
+  }
+  lua_pushnumber(L, self->__current);
+  return 1;
+}
+int TimeSeriesSource::_set_window_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  self->set_window(luaL_checkinteger(L, 2), luaL_checkinteger(L, 3));
+  return 0;
+}
+int TimeSeriesSource::_get_num_frames_(lua_State *L)
+{
+  TimeSeriesSource *self = checkarg<TimeSeriesSource>(L, 1);
+  lua_pushnumber(L, self->get_num_frames());
+  return 1;
+}
@@ -0,0 +1,78 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * Trilinear sampling of 3d DataSource arrays on the CPU. An array has shape
+ * (N[0],N[1],N[2],nc), so that the last spatial axis varies fastest, and
+ * positions are given as continuous indices: voxel (i,j,k) is at (i,j,k), and
+ * positions outside the array are clamped to its faces, as OpenGL's linear
+ * filter does for a clamped texture.
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef __LuviewTrilinear_HEADER__
+#define __LuviewTrilinear_HEADER__
+
+#include <cmath>
+
+
+static inline void trilinear_weights(double x, int N, int &i, double &w)
+// -----------------------------------------------------------------------------
+// Finds the lower of the two voxels around x along an axis of size N, and the
+// weight of the upper one.
+// -----------------------------------------------------------------------------
+{
+  if (x <= 0.0 || N < 2) {
+    i = 0;
+    w = 0.0;
+  }
+  else if (x >= N - 1) {
+    i = N - 2;
+    w = 1.0;
+  }
+  else {
+    i = (int) x;
+    w = x - i;
+  }
+}
+
+static inline void trilinear(const GLfloat *f, const int *N, int nc,
+                             double x0, double x1, double x2, double *res)
+// -----------------------------------------------------------------------------
+// Writes the nc components of f at (x0,x1,x2) into res.
+// -----------------------------------------------------------------------------
+{
+  int i, j, k;
+  double u, v, w;
+  trilinear_weights(x0, N[0], i, u);
+  trilinear_weights(x1, N[1], j, v);
+  trilinear_weights(x2, N[2], k, w);
+
+  const int s0 = N[0] > 1 ? N[1]*N[2]*nc : 0;
+  const int s1 = N[1] > 1 ? N[2]*nc : 0;
+  const int s2 = N[2] > 1 ? nc : 0;
+  const GLfloat *p = f + ((i*N[1] + j)*N[2] + k)*nc;
+
+  for (int c=0; c<nc; ++c, ++p) {
+    const double a = p[0]  + w*(p[s2] - p[0]);
+    const double b = p[s1] + w*(p[s1 + s2] - p[s1]);
+    const double d = p[s0] + w*(p[s0 + s2] - p[s0]);
+    const double e = p[s0 + s1] + w*(p[s0 + s1 + s2] - p[s0 + s1]);
+    const double ab = a + v*(b - a);
+    const double de = d + v*(e - d);
+    res[c] = ab + u*(de - ab);
+  }
+}
+
+static inline double trilinear(const GLfloat *f, const int *N,
+                               double x0, double x1, double x2)
+// -----------------------------------------------------------------------------
+// Samples a scalar array at (x0,x1,x2).
+// -----------------------------------------------------------------------------
+{
+  double res;
+  trilinear(f, N, 1, x0, x1, x2, &res);
+  return res;
+}
+
+#endif // __LuviewTrilinear_HEADER__
@@ -1,219 +1,341 @@
 
+/* -----------------------------------------------------------------------------
+ *
+ * VolumeRendering: ray marching through the "volume" DataSource, a 3d array of
+ * scalars in luminance mode, mapped to color and opacity by the "color_table".
+ *
+ * NOTES:
+ *
+ * The volume fills the unit cube centered on the origin, whose corners are
+ * colored by their texture coordinates. Its back faces are drawn into the exit
+ * target and its front faces into the entry target, so that every pixel holds
+ * the end points of its ray through the volume. Pixels whose front face was
+ * clipped by the near plane have a zero entry alpha, and start at the eye.
+ *
+ * The rays are marched in half voxel steps, front to back, and stop once they
+ * are all but opaque. The volume is also divided into bricks of 8^3 voxels,
+ * which are flagged on the CPU whenever the color table is transparent over
+ * the whole range of their values. Rays skip over flagged bricks in one step.
+ *
+ * The volume is composited over whatever has been drawn before it, without
+ * regard to depth.
+ *
+ * -----------------------------------------------------------------------------
+ */
 
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
 #include <cmath>
-#include <ctime>
+#include <algorithm>
 #include "luview.hpp"
-#include "teapot.h"
-
-#define GL_GLEXT_PROTOTYPES
-#include <GL/glext.h>
-#define glBindFramebuffer glBindFramebufferEXT
-#define glGenRenderbuffers glGenRenderbuffersEXT
-#define glGenFramebuffers glGenFramebuffersEXT
-#define glDeleteRenderbuffers glDeleteRenderbuffersEXT
-#define glDeleteFramebuffers glDeleteFramebuffersEXT
-#define glRenderbufferStorage glRenderbufferStorageEXT
-#define glFramebufferRenderbuffer glFramebufferRenderbufferEXT
-#define glBindRenderbuffer glBindRenderbufferEXT
-#define glFramebufferTexture2D glFramebufferTexture2DEXT
-#define glCheckFramebufferStatus glCheckFramebufferStatusEXT
-#define glGenerateMipmap glGenerateMipmapEXT
-
-#define GL_FRAMEBUFFER GL_FRAMEBUFFER_EXT
-#define GL_RENDERBUFFER GL_RENDERBUFFER_EXT
-#define GL_DEPTH_ATTACHMENT GL_DEPTH_ATTACHMENT_EXT
-#define GL_COLOR_ATTACHMENT0 GL_COLOR_ATTACHMENT0_EXT
-#define GL_FRAMEBUFFER_COMPLETE GL_FRAMEBUFFER_COMPLETE_EXT
-
-
-static void draw_cube_back()
+#include "bricks.hpp"
+
+#define __VOLUME_BRICK 8 // number of voxels along the side of a brick
+
+
+static const char *MarchVert = "\
+void main()\n\
+{\n\
+  gl_Position = ftransform();\n\
+}\n";
+
+static const char *MarchFrag = "\
+uniform sampler1D tex1d;\n\
+uniform sampler3D volume;\n\
+uniform sampler3D bricks;\n\
+uniform sampler2D entry_tex;\n\
+uniform sampler2D exit_tex;\n\
+uniform vec4 viewport;\n\
+uniform vec3 eye;\n\
+uniform vec3 voxels;\n\
+uniform vec3 brick_count;\n\
+uniform float brick_size;\n\
+uniform float step_size;\n\
+uniform int max_steps;\n\
+uniform float density;\n\
+void main()\n\
+{\n\
+  vec2 st = (gl_FragCoord.xy - viewport.xy) / viewport.zw;\n\
+  vec4 a = texture2D(entry_tex, st);\n\
+  vec3 p0 = a.a > 0.0 ? a.rgb : clamp(eye, 0.0, 1.0);\n\
+  vec3 d = texture2D(exit_tex, st).rgb - p0;\n\
+  float len = length(d);\n\
+  if (len < 1e-6) discard;\n\
+  d /= len;\n\
+\n\
+  vec3 extent = brick_size / voxels;\n\
+  vec4 acc = vec4(0.0);\n\
+  float t = 0.5*step_size;\n\
+  for (int n=0; n<max_steps && t<len; ++n) {\n\
+    vec3 p = p0 + t*d;\n\
+    vec3 cell = min(floor(p / extent), brick_count - 1.0);\n\
+    if (texture3D(bricks, (cell + 0.5) / brick_count).r < 0.5) {\n\
+      vec3 bound = (cell + step(0.0, d)) * extent;\n\
+      vec3 tb = abs((bound - p) / max(abs(d), vec3(1e-6)));\n\
+      float skip = min(tb.x, min(tb.y, tb.z));\n\
+      t += max(ceil(skip / step_size), 1.0) * step_size;\n\
+      continue;\n\
+    }\n\
+    vec4 c = texture1D(tex1d, texture3D(volume, p).r);\n\
+    float alpha = 1.0 - exp(-density * c.a * step_size);\n\
+    acc.rgb += (1.0 - acc.a) * alpha * c.rgb;\n\
+    acc.a += (1.0 - acc.a) * alpha;\n\
+    if (acc.a >= 0.99) break;\n\
+    t += step_size;\n\
+  }\n\
+  gl_FragColor = acc;\n\
+}\n";
+
+
+static void draw_cube()
+// -----------------------------------------------------------------------------
+// Draws the unit cube with its faces wound counter-clockwise from outside, and
+// each corner colored by its texture coordinate.
+// -----------------------------------------------------------------------------
 {
-  const GLfloat x0 = -0.5;
-  const GLfloat x1 = +0.5;
-  const GLfloat c0 =  0.0;
-  const GLfloat c1 =  1.0;
-
-  glPolygonMode(GL_FRONT, GL_FILL);
-  glPolygonMode(GL_BACK, GL_FILL);
-
-  glBegin(GL_QUADS);
-  glNormal3f(0,0,-1);
-  glColor3f(c1,c1,c1); glVertex3f(x1,x1,x1);
-  glColor3f(c0,c1,c1); glVertex3f(x0,x1,x1);
-  glColor3f(c0,c0,c1); glVertex3f(x0,x0,x1);
-  glColor3f(c1,c0,c1); glVertex3f(x1,x0,x1);
-  glEnd();
-
-  glBegin(GL_QUADS);
-  glNormal3f(-1,0,0);
-  glColor3f(c1,c1,c1); glVertex3f(x1,x1,x1);
-  glColor3f(c1,c0,c1); glVertex3f(x1,x0,x1);
-  glColor3f(c1,c0,c0); glVertex3f(x1,x0,x0);
-  glColor3f(c1,c1,c0); glVertex3f(x1,x1,x0);
-  glEnd();
+  static const GLfloat faces[6][4][3] = {
+    {{1,0,0}, {1,1,0}, {1,1,1}, {1,0,1}},
+    {{0,0,0}, {0,0,1}, {0,1,1}, {0,1,0}},
+    {{0,1,0}, {0,1,1}, {1,1,1}, {1,1,0}},
+    {{0,0,0}, {1,0,0}, {1,0,1}, {0,0,1}},
+    {{0,0,1}, {1,0,1}, {1,1,1}, {0,1,1}},
+    {{0,0,0}, {0,1,0}, {1,1,0}, {1,0,0}} };
 
   glBegin(GL_QUADS);
-  glNormal3f(0,-1,0);
-  glColor3f(c0,c0,c0); glVertex3f(x0,x0,x0);
-  glColor3f(c1,c0,c0); glVertex3f(x1,x0,x0);
-  glColor3f(c1,c0,c1); glVertex3f(x1,x0,x1);
-  glColor3f(c0,c0,c1); glVertex3f(x0,x0,x1);
+  for (int f=0; f<6; ++f) {
+    for (int v=0; v<4; ++v) {
+      const GLfloat *c = faces[f][v];
+      glColor4f(c[0], c[1], c[2], 1.0);
+      glVertex3f(c[0] - 0.5, c[1] - 0.5, c[2] - 0.5);
+    }
+  }
   glEnd();
 }
 
-static void draw_cube_front()
-{
-  const GLfloat x0 = -0.5;
-  const GLfloat x1 = +0.5;
-  const GLfloat c0 =  0.0;
-  const GLfloat c1 =  1.0;
-
-  glPolygonMode(GL_FRONT, GL_FILL);
-  glPolygonMode(GL_BACK, GL_FILL);
-
-  glBegin(GL_QUADS);
-  glNormal3f(0,0,1);
-  glColor3f(c0,c0,c0); glVertex3f(x0,x0,x0);
-  glColor3f(c0,c1,c0); glVertex3f(x0,x1,x0);
-  glColor3f(c1,c1,c0); glVertex3f(x1,x1,x0);
-  glColor3f(c1,c0,c0); glVertex3f(x1,x0,x0);
-  glEnd();
-
-  glBegin(GL_QUADS);
-  glNormal3f(1,0,0);
-  glColor3f(c0,c0,c0); glVertex3f(x0,x0,x0);
-  glColor3f(c0,c0,c1); glVertex3f(x0,x0,x1);
-  glColor3f(c0,c1,c1); glVertex3f(x0,x1,x1);
-  glColor3f(c0,c1,c0); glVertex3f(x0,x1,x0);
-  glEnd();
-
-  glBegin(GL_QUADS);
-  glNormal3f(0,1,0);
-  glColor3f(c0,c1,c0); glVertex3f(x0,x1,x0);
-  glColor3f(c0,c1,c1); glVertex3f(x0,x1,x1);
-  glColor3f(c1,c1,c1); glVertex3f(x1,x1,x1);
-  glColor3f(c1,c1,c0); glVertex3f(x1,x1,x0);
-  glEnd();
-}
 
 VolumeRendering::VolumeRendering()
+  : density(5.0),
+    entry_fb(NULL),
+    exit_fb(NULL),
+    march_shader(NULL),
+    bricks_volume(NULL),
+    bricks_table(NULL),
+    bricks_volume_version(-1),
+    bricks_table_version(-1)
 {
-  gl_modes.push_back(GL_TEXTURE_2D);
-  // gl_modes.push_back(GL_CULL_FACE);
-  // gl_modes.push_back(GL_LIGHTING);
-  // gl_modes.push_back(GL_LIGHT0);
-  // gl_modes.push_back(GL_BLEND);
-  // gl_modes.push_back(GL_COLOR_MATERIAL);
+  gl_modes.push_back(GL_CULL_FACE);
+  glGenTextures(1, &bricks);
+  brick_count[0] = brick_count[1] = brick_count[2] = 0;
 }
-
-
-void VolumeRendering::draw_local()
+VolumeRendering::~VolumeRendering()
 {
-  static int count = 0;
-  ++count;
-  if (count % 1000 == 0) {
-    if ((count / 1000) % 2 == 0) {
-      printf("switching to less\n");
-      glClearDepth(1);
-      glDepthFunc(GL_LESS);
-    }
-    else {
-      printf("switching to greater\n");
-      glClearDepth(0);
-      glDepthFunc(GL_GREATER);
-    }
-  }
-  glClearColor(0.0, 0.0, 0.0, 0.0);
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-  glPointSize(10);
-  draw_cube_back();
-  draw_cube_front();
+  delete entry_fb;
+  delete exit_fb;
+  glDeleteTextures(1, &bricks);
 }
 
-static void draw_local1()
+void VolumeRendering::build_bricks(DataSource *vol, DataSource *lut)
+// -----------------------------------------------------------------------------
+// Flags the bricks through which the color table is transparent everywhere.
+// Each brick's value range takes in the voxels one beyond its faces, so that
+// it covers every voxel which the linear filter may blend into a sample taken
+// inside it. Likewise the range of the color table takes in the texels either
+// side of the values.
+// -----------------------------------------------------------------------------
 {
-  int Nx=512, Ny=512;
-
-  GLuint texId;
-  GLuint fboId;
-  GLuint rboId;
-
-  glGenTextures(1, &texId);
-  glGenFramebuffers(1, &fboId);
-  glGenRenderbuffers(1, &rboId);
-
-  glBindTexture(GL_TEXTURE_2D, texId);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, Nx, Ny, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
+  const int B = __VOLUME_BRICK;
+  const GLfloat *data = vol->get_data();
+  const GLfloat *table = lut->get_data();
+  int N[3], nb[3];
+
+  for (int d=0; d<3; ++d) {
+    N[d] = vol->get_num_points(d);
+    nb[d] = brick_count[d] = (N[d] + B - 1) / B;
+  }
+  const int Nb = nb[0]*nb[1]*nb[2];
+  std::vector<GLfloat> lo(Nb), hi(Nb);
+  std::vector<GLubyte> flags(Nb);
 
-  glBindRenderbuffer(GL_RENDERBUFFER, rboId);
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, Nx, Ny);
-  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  brick_ranges(data, N, B, 1, nb, &lo[0], &hi[0]);
+  for (int n=0; n<Nb; ++n) {
+    flags[n] = table_is_transparent(table, lo[n], hi[n]) ? 0 : 255;
+  }
 
+  glBindTexture(GL_TEXTURE_3D, bricks);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_LUMINANCE8, nb[2], nb[1], nb[0], 0,
+               GL_LUMINANCE, GL_UNSIGNED_BYTE, &flags[0]);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  bricks_volume = vol;
+  bricks_table = lut;
+  bricks_volume_version = vol->get_version();
+  bricks_table_version = lut->get_version();
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, fboId);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-                         GL_TEXTURE_2D, texId, 0);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                            GL_RENDERBUFFER, rboId);
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void VolumeRendering::draw_local()
+{
+  EntryDS vol = DataSources.find("volume");
+  EntryDS lut = DataSources.find("color_table");
+
+  if (vol == DataSources.end() || lut == DataSources.end()) return;
+
+  vol->second->compile();
+  vol->second->check_has_data("volume");
+  vol->second->check_num_dimensions("volume", 3);
+  lut->second->compile();
+  lut->second->check_has_data("color_table");
+  lut->second->check_num_dimensions("color_table", 2);
+  lut->second->check_num_points("color_table", 256, 0);
+  lut->second->check_num_points("color_table", 4, 1);
+
+  GLint vp[4];
+  glGetIntegerv(GL_VIEWPORT, vp);
+
+  if (entry_fb == NULL) {
+    entry_fb = new FrameBuffer(true);
+    exit_fb = new FrameBuffer(true);
+    hold(march_shader = create<ShaderProgram>(__lua_state));
+    march_shader->set_program(MarchVert, MarchFrag);
+  }
+  if (!entry_fb->resize(vp[2], vp[3]) || !exit_fb->resize(vp[2], vp[3])) {
+    luaL_error(__lua_state, "volume rendering is not supported by this OpenGL "
+               "driver");
+  }
+  if (bricks_volume != vol->second ||
+      bricks_table != lut->second ||
+      bricks_volume_version != vol->second->get_version() ||
+      bricks_table_version != lut->second->get_version()) {
+    build_bricks(vol->second, lut->second);
+  }
 
+  // Draw the ray end points, in texture coordinates.
+  // ---------------------------------------------------------------------------
+  GLfloat clear[4];
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+  glClearColor(0.0, 0.0, 0.0, 0.0);
+  GLStateCache::use_program(0);
 
-  // switch to drawing on the frame buffer
-  glBindFramebuffer(GL_FRAMEBUFFER, fboId);
-  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-    printf("warning! the fbo is not complete\n");
-  }
+  exit_fb->bind();
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glCullFace(GL_FRONT);
+  draw_cube();
+  exit_fb->release();
 
-  glPushAttrib(GL_ALL_ATTRIB_BITS);
-  glPushMatrix();
-  glClearColor(0.5, 0.5, 1.0, 1.0);
+  entry_fb->bind();
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glViewport(0,0,Nx,Ny);
-
-  glLoadIdentity();
-  glTranslatef(0,0.15,-2.4);
-  glRotatef(30,1,0,0);
-  glRotatef(180-45,0,1,0);
-  //  draw_cube_back();
-  draw_cube_front();
-
-  glPopMatrix();
-  glPopAttrib();
-  glBindFramebuffer(GL_FRAMEBUFFER, 0); // unbind FBO
-
-
-
-  // trigger mipmaps generation explicitly
-  // NOTE: If GL_GENERATE_MIPMAP is set to GL_TRUE, then glCopyTexSubImage2D()
-  // triggers mipmap generation automatically. However, the texture attached
-  // onto a FBO should generate mipmaps manually via glGenerateMipmap().
-  glBindTexture(GL_TEXTURE_2D, texId);
-  glGenerateMipmap(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  glBindTexture(GL_TEXTURE_2D, texId);
-  glBegin(GL_POLYGON);
-  glNormal3f(0,0,1);
-  glTexCoord2d(0,0); glVertex2f(-0.5,-0.5);
-  glTexCoord2d(0,1); glVertex2f(-0.5, 0.5);
-  glTexCoord2d(1,1); glVertex2f( 0.5, 0.5);
-  glTexCoord2d(1,0); glVertex2f( 0.5,-0.5);
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D, 0);
+  glCullFace(GL_BACK);
+  draw_cube();
+  entry_fb->release();
+
+  glClearColor(clear[0], clear[1], clear[2], clear[3]);
+
+  // Find the eye in texture coordinates, for rays starting inside the volume.
+  // ---------------------------------------------------------------------------
+  double MV[16], MVinv[16];
+  glGetDoublev(GL_MODELVIEW_MATRIX, MV);
+  if (!ViewFrustum::invert(MV, MVinv)) return;
+  const GLfloat eye[3] = { GLfloat(MVinv[12] / MVinv[15] + 0.5),
+                           GLfloat(MVinv[13] / MVinv[15] + 0.5),
+                           GLfloat(MVinv[14] / MVinv[15] + 0.5) };
+
+  // March the rays from the back faces, so that they are drawn even when the
+  // front ones are clipped.
+  // ---------------------------------------------------------------------------
+  DataSource *v = vol->second;
+  const int B = __VOLUME_BRICK;
+  const int Nmax = std::max(v->get_num_points(0),
+                            std::max(v->get_num_points(1),
+                                     v->get_num_points(2)));
+  const GLfloat viewport[4] = { GLfloat(vp[0]), GLfloat(vp[1]),
+                                GLfloat(vp[2]), GLfloat(vp[3]) };
+  const GLfloat voxels[3] = { GLfloat(v->get_num_points(2)),
+                              GLfloat(v->get_num_points(1)),
+                              GLfloat(v->get_num_points(0)) };
+  const GLfloat count[3] = { GLfloat(brick_count[2]),
+                             GLfloat(brick_count[1]),
+                             GLfloat(brick_count[0]) };
+  const GLfloat brick_size = B;
+  const GLfloat step_size = 0.5 / Nmax;
+  const int max_steps = int(ceil(sqrt(3.0) / step_size)) + 1; // cube diagonal
+  const GLfloat dens = density;
+
+  glActiveTexture(GL_TEXTURE0 + 0);
+  lut->second->become_texture();
+  glActiveTexture(GL_TEXTURE0 + 1);
+  v->become_texture();
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glActiveTexture(GL_TEXTURE0 + 2);
+  glBindTexture(GL_TEXTURE_3D, bricks);
+  glActiveTexture(GL_TEXTURE0 + 3);
+  glBindTexture(GL_TEXTURE_2D, entry_fb->get_texture());
+  glActiveTexture(GL_TEXTURE0 + 4);
+  glBindTexture(GL_TEXTURE_2D, exit_fb->get_texture());
+
+  march_shader->set_uniform("tex1d", 0);
+  march_shader->set_uniform("volume", 1);
+  march_shader->set_uniform("bricks", 2);
+  march_shader->set_uniform("entry_tex", 3);
+  march_shader->set_uniform("exit_tex", 4);
+  march_shader->set_uniform_vec("viewport", viewport, 4);
+  march_shader->set_uniform_vec("eye", eye, 3);
+  march_shader->set_uniform_vec("voxels", voxels, 3);
+  march_shader->set_uniform_vec("brick_count", count, 3);
+  march_shader->set_uniform_vec("brick_size", &brick_size, 1);
+  march_shader->set_uniform_vec("step_size", &step_size, 1);
+  march_shader->set_uniform("max_steps", max_steps);
+  march_shader->set_uniform_vec("density", &dens, 1);
+  GLStateCache::use_program(march_shader->get_id());
+
+  // The shader returns color premultiplied by alpha. The blend functions are
+  // put back as found, since the Window's transparency passes set their own.
+  GLint blend[4];
+  glGetIntegerv(GL_BLEND_SRC_RGB, &blend[0]);
+  glGetIntegerv(GL_BLEND_DST_RGB, &blend[1]);
+  glGetIntegerv(GL_BLEND_SRC_ALPHA, &blend[2]);
+  glGetIntegerv(GL_BLEND_DST_ALPHA, &blend[3]);
+  GLStateCache::enable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glCullFace(GL_FRONT);
+  draw_cube();
+  glCullFace(GL_BACK);
+  glBlendFuncSeparate(blend[0], blend[1], blend[2], blend[3]);
+
+  const GLenum targets[5] = { GL_TEXTURE_1D, GL_TEXTURE_3D, GL_TEXTURE_3D,
+                              GL_TEXTURE_2D, GL_TEXTURE_2D };
+  for (int k=4; k>=0; --k) {
+    glActiveTexture(GL_TEXTURE0 + k);
+    glBindTexture(targets[k], 0);
+  }
+}
 
 
-  glDeleteTextures(1, &texId);
-  glDeleteFramebuffers(1, &fboId);
-  glDeleteRenderbuffers(1, &rboId);
+VolumeRendering::LuaInstanceMethod
+VolumeRendering::__getattr__(std::string &method_name)
+{
+  AttributeMap attr;
+  attr["get_density"] = _get_density_;
+  attr["set_density"] = _set_density_;
+  RETURN_ATTR_OR_CALL_SUPER(DrawableObject);
+}
+int VolumeRendering::_get_density_(lua_State *L)
+{
+  VolumeRendering *self = checkarg<VolumeRendering>(L, 1);
+  lua_pushnumber(L, self->density);
+  return 1;
+}
+int VolumeRendering::_set_density_(lua_State *L)
+{
+  VolumeRendering *self = checkarg<VolumeRendering>(L, 1);
+  const double d = luaL_checknumber(L, 2);
+  if (d < 0.0) {
+    luaL_error(L, "density must be non-negative");
+  }
+  self->density = d;
+  ++self->Revision;
+  return 0;
 }
@@ -0,0 +1,85 @@
+
+/* -----------------------------------------------------------------------------
+ *
+ * Counts the heap allocations made per CallbackFunction call, comparing the
+ * std::vector returning overloads with the in-place interface.
+ *
+ * USAGE: $> ./allocs [number of calls]
+ *
+ * -----------------------------------------------------------------------------
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "luview.hpp"
+
+static long num_allocs = 0;
+
+void *operator new(size_t n)
+{
+  ++num_allocs;
+  void *p = malloc(n);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void *p) throw()
+{
+  free(p);
+}
+
+static void report(const char *name, long allocs, int ncalls)
+{
+  printf("%-24s %8.3f allocations per call\n", name, (double) allocs / ncalls);
+}
+
+extern "C" int luaopen_luview(lua_State *L);
+
+int main(int argc, char **argv)
+{
+  const int ncalls = argc > 1 ? atoi(argv[1]) : 100000;
+  lua_State *L = luaL_newstate();
+  luaL_openlibs(L);
+  luaL_requiref(L, "luview", luaopen_luview, false);
+  lua_pop(L, 1);
+
+  // Both callbacks are made by Lua and anchored in the registry, so that the
+  // allocations being counted cannot trigger their collection.
+  luaL_loadstring(L, "local d = require('luview').DataSource() "
+                  "d:set_transform(function(u,v,w) return u+v, v*w, w end) "
+                  "return d:get_transform()");
+  lua_call(L, 0, 1);
+  CallbackFunction *lf = CallbackFunction::create_from_stack(L, -1);
+  const int lf_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  luaL_loadstring(L, "local f = require('luview').ExpressionFunction() "
+                  "f:set_expression('u+v, v*w, w') return f");
+  lua_call(L, 0, 1);
+  CallbackFunction *ef = CallbackFunction::create_from_stack(L, -1);
+  const int ef_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  double x[3] = { 1.0, 2.0, 3.0 };
+  double res[__CALLBACK_MAXARGS];
+  long n0;
+
+  n0 = num_allocs;
+  for (int n=0; n<ncalls; ++n) lf->call(x[0], x[1], x[2]);
+  report("LuaFunction (vector)", num_allocs - n0, ncalls);
+
+  n0 = num_allocs;
+  for (int n=0; n<ncalls; ++n) lf->call(x, 3, res);
+  report("LuaFunction (in-place)", num_allocs - n0, ncalls);
+
+  n0 = num_allocs;
+  for (int n=0; n<ncalls; ++n) ef->call(x[0], x[1], x[2]);
+  report("Expression (vector)", num_allocs - n0, ncalls);
+
+  n0 = num_allocs;
+  for (int n=0; n<ncalls; ++n) ef->call(x, 3, res);
+  report("Expression (in-place)", num_allocs - n0, ncalls);
+
+  luaL_unref(L, LUA_REGISTRYINDEX, lf_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, ef_ref);
+  lua_close(L);
+  return 0;
+}
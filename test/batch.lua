@@ -0,0 +1,59 @@
+
+local lunum = require 'lunum'
+local luview = require 'luview'
+
+local window = luview.Window()
+local grid = luview.GridSource2D()
+local pnt = luview.FunctionMapping()
+local vec = luview.FunctionMapping()
+local exp = luview.FunctionMapping()
+local par = luview.FunctionMapping()
+local expr = luview.ExpressionFunction()
+
+local function f(u,v)
+   return u, v, lunum.sin(10*u) * lunum.cos(10*v)
+end
+
+local sin, cos = math.sin, math.cos
+local k = 10
+local function g(u,v)
+   return u, v, sin(k*u) * cos(k*v)
+end
+
+grid:set_num_points(256, 256)
+pnt:set_input(grid)
+pnt:set_transform(f)
+vec:set_input(grid)
+vec:set_transform(f, "batch")
+expr:set_parameter("k", 10)
+expr:set_expression("u, v, sin(k*u) * cos(k*v)")
+exp:set_input(grid)
+exp:set_transform(expr)
+par:set_input(grid)
+par:set_transform(g, "parallel")
+
+local t0 = os.clock()
+pnt:compile()
+local t1 = os.clock()
+vec:compile()
+local t2 = os.clock()
+exp:compile()
+local t3 = os.clock()
+par:compile()
+local t4 = os.clock()
+
+print("per point: ", t1 - t0)
+print("batched:   ", t2 - t1)
+print("expression:", t3 - t2)
+print("parallel:  ", t4 - t3)
+
+local A = pnt:get_data()
+local B = vec:get_data()
+local C = exp:get_data()
+local D = par:get_data()
+local err = 0.0
+for i=0,256*256*3-1 do
+   err = math.max(err, math.abs(A[i] - B[i]), math.abs(A[i] - C[i]),
+                  math.abs(A[i] - D[i]))
+end
+print("max difference: ", err)
@@ -0,0 +1,59 @@
+
+
+local luview = require 'luview'
+local shaders = require 'shaders'
+local fields = require 'fields'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local field = luview.DataSource()
+local iso = luview.IsosurfaceSource()
+local decimate = luview.MeshDecimationSource()
+local triangles = luview.TrianglesEnsemble()
+local pyluts = luview.MatplotlibColormaps()
+local lights = shaders.load_shader("multlights")
+
+-- a finely resolved level set of a wavy sphere
+local rho = fields.sample(128, function(x, y, z)
+   local r = math.sqrt(x*x + y*y + z*z)
+   return r + 0.02*math.sin(20*x)*math.sin(20*y)*math.sin(20*z)
+end)
+
+field:set_mode("luminance")
+field:set_data(rho)
+
+iso:set_input(field)
+iso:set_iso_value(0.3)
+
+decimate:set_input(iso:get_output("mesh"))
+decimate:set_target(5000)
+
+local function show(source)
+   triangles:set_data("triangles", source:get_output("triangles"))
+   triangles:set_data("normals", source:get_output("normals"))
+   triangles:set_data("scalars", source:get_output("scalars"))
+end
+show(decimate)
+triangles:set_data("color_table", pyluts)
+triangles:set_shader(lights)
+iso:get_output("mesh"):set_normalize(true)
+decimate:get_output("mesh"):set_normalize(true)
+
+box:set_color(0.5, 0.9, 0.9)
+window:set_color(0.2, 0.2, 0.2)
+
+local function scale_target(factor)
+   decimate:set_target(math.max(math.floor(decimate:get_target()*factor), 100))
+   decimate:get_output("mesh"):compile()
+   print(string.format("target %d, %d triangles", decimate:get_target(),
+                       decimate:get_num_triangles()))
+end
+local full = false
+window:set_callback("+", function() scale_target(2.0) end, "double the target")
+window:set_callback("-", function() scale_target(0.5) end, "halve the target")
+window:set_callback("f", function()
+   full = not full
+   show(full and iso or decimate)
+end, "toggle the full resolution surface")
+
+while window:render_scene{box, triangles} == "continue" do end
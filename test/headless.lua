@@ -0,0 +1,43 @@
+
+
+-- Renders a turntable of frames without user input. Built with
+-- OSMESA=-D__LUVIEW_USE_OSMESA this runs on machines with no display.
+
+local luview = require 'luview'
+local shaders = require 'shaders'
+local fields = require 'fields'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local field = luview.DataSource()
+local iso = luview.IsosurfaceSource()
+local triangles = luview.TrianglesEnsemble()
+local pyluts = luview.MatplotlibColormaps()
+local lights = shaders.load_shader("multlights")
+
+local rho = fields.sample(64, function(x, y, z)
+   return math.sqrt(x*x + y*y + z*z) + 0.05*math.cos(12*x)*math.cos(12*y)
+end)
+field:set_mode("luminance")
+field:set_data(rho)
+
+iso:set_input(field)
+iso:set_iso_value(0.3)
+iso:get_output("mesh"):set_normalize(true)
+
+triangles:set_data("triangles", iso:get_output("triangles"))
+triangles:set_data("normals", iso:get_output("normals"))
+triangles:set_data("scalars", iso:get_output("scalars"))
+triangles:set_data("color_table", pyluts)
+triangles:set_shader(lights)
+
+window:set_size(640, 480)
+window:set_color(0.1, 0.1, 0.1)
+
+local nframes = 36
+for n=0,nframes-1 do
+   window:set_orientation(20, 360*n/nframes, 0)
+   window:render_scene{box, triangles}
+   window:print_screen("headless")
+end
+print(string.format("wrote %d frames of %dx%d", nframes, window:get_size()))
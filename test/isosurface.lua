@@ -0,0 +1,51 @@
+
+
+local luview = require 'luview'
+local shaders = require 'shaders'
+local fields = require 'fields'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local field = luview.DataSource()
+local iso = luview.IsosurfaceSource()
+local triangles = luview.TrianglesEnsemble()
+local pyluts = luview.MatplotlibColormaps()
+local lights = shaders.load_shader("multlights")
+
+-- three blobs, whose level sets merge as the iso value drops
+local centers = {{-0.2,-0.1,0.0}, {0.2,0.0,0.1}, {0.0,0.2,-0.15}}
+local rho = fields.sample(96, function(x, y, z)
+   local f = 0
+   for _,c in ipairs(centers) do
+      local r2 = (x-c[1])^2 + (y-c[2])^2 + (z-c[3])^2
+      f = f + math.exp(-r2/0.01)
+   end
+   return f
+end)
+
+field:set_mode("luminance")
+field:set_data(rho)
+field:set_normalize(true)
+
+iso:set_input(field)
+iso:set_iso_value(0.5)
+
+triangles:set_data("triangles", iso:get_output("triangles"))
+triangles:set_data("normals", iso:get_output("normals"))
+triangles:set_data("scalars", iso:get_output("scalars"))
+triangles:set_data("color_table", pyluts)
+triangles:set_shader(lights)
+iso:get_output("mesh"):set_normalize(true)
+
+box:set_color(0.5, 0.9, 0.9)
+window:set_color(0.2, 0.2, 0.2)
+
+local function step_iso(dv)
+   iso:set_iso_value(math.min(math.max(iso:get_iso_value() + dv, 0.01), 0.99))
+   print(string.format("iso value %4.2f, %d active blocks",
+                       iso:get_iso_value(), iso:get_num_active_blocks()))
+end
+window:set_callback("+", function() step_iso( 0.05) end, "raise the iso value")
+window:set_callback("-", function() step_iso(-0.05) end, "lower the iso value")
+
+while window:render_scene{box, triangles} == "continue" do end
@@ -0,0 +1,45 @@
+
+
+local luview = require 'luview'
+local lunum = require 'lunum'
+local shaders = require 'shaders'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local image = luview.ImagePlane()
+local field = luview.DataSource()
+local pyluts = luview.MatplotlibColormaps()
+local cmshade = shaders.load_shader("cbar")
+
+local N = 256
+local rho = lunum.zeros{N,N}
+for m=0,N*N-1 do
+   local x, y = (m % N)/N - 0.5, math.floor(m/N)/N - 0.5
+   rho[m] = math.sin(30*x*y) * math.exp(-(x*x + y*y)/0.1)
+end
+field:set_mode("luminance")
+field:set_data(rho)
+field:set_normalize(true)
+
+image:set_data("image", field)
+image:set_data("color_table", pyluts)
+image:set_shader(cmshade)
+
+-- with nothing changing, the loop below sleeps on input instead of drawing
+window:set_on_demand(true)
+window:set_color(0.2, 0.2, 0.2)
+window:set_callback("o", function()
+   window:set_on_demand(not window:get_on_demand())
+   print("on demand:", window:get_on_demand())
+end, "toggle drawing on demand")
+window:set_callback("]", function() pyluts:next_colormap() end, "next colormap")
+window:set_callback("[", function() pyluts:prev_colormap() end, "previous colormap")
+
+local loops, start = 0, os.clock()
+while window:render_scene{box, image} == "continue" do
+   loops = loops + 1
+   if loops % 100 == 0 then
+      print(string.format("%d passes through the loop, %f seconds of cpu",
+                          loops, os.clock() - start))
+   end
+end
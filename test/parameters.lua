@@ -0,0 +1,48 @@
+local lunum = require 'lunum'
+local luview = require 'luview'
+
+local window = luview.Window()
+local grid = luview.GridSource2D()
+local wave = luview.FunctionMapping()
+local lift = luview.FunctionMapping()
+local expr = luview.ExpressionFunction()
+
+local function h(x,y,z)
+   return x, y, z + 1
+end
+
+grid:set_num_points(64, 64)
+expr:set_parameter("t", 0)
+expr:set_expression("u, v, sin(10*u + t)")
+wave:set_input(grid)
+wave:set_transform(expr)
+lift:set_input(wave)
+lift:set_transform(h)
+
+local function changed(A, B)
+   local diff = 0.0
+   for i=0,64*64*3-1 do
+      diff = math.max(diff, math.abs(A[i] - B[i]))
+   end
+   return diff
+end
+
+lift:compile()
+local A = wave:get_data()
+local C = lift:get_data()
+
+-- Changing a parameter must restage the mapping using the expression, and
+-- everything downstream of it, without the transform being set again.
+expr:set_parameter("t", 1)
+lift:compile()
+local B = wave:get_data()
+local D = lift:get_data()
+
+print("change in mapping:    ", changed(A, B))
+print("change in downstream: ", changed(C, D))
+assert(changed(A, B) > 0.1, "mapping was not restaged")
+assert(changed(C, D) > 0.1, "downstream mapping was not restaged")
+
+expr:set_expression("u, v, sin(10*u + t)")
+lift:compile()
+print("after resetting expression: ", changed(B, wave:get_data()))
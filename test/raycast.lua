@@ -0,0 +1,46 @@
+
+
+local luview = require 'luview'
+local fields = require 'fields'
+
+local window = luview.Window()
+local image = luview.ImagePlane()
+local field = luview.DataSource()
+local lut = luview.DataSource()
+local caster = luview.VolumeRayCaster()
+
+-- a tilted ring around a dense blob, empty elsewhere so that most of the
+-- macrocells are skipped
+local rho = fields.sample(96, function(x, y, z)
+   local u, v, w = x, -0.6*y + 0.8*z, 0.8*y + 0.6*z
+   local ring = math.sqrt(u*u + v*v) - 0.3
+   local blob = (x - 0.1)^2 + (y + 0.05)^2 + z*z
+   return math.exp(-(ring*ring + w*w)/0.003) + 0.8*math.exp(-blob/0.004)
+end)
+
+lut:set_mode("rgba")
+lut:set_data(fields.ramp(0.2))
+
+field:set_mode("luminance")
+field:set_data(rho)
+field:set_normalize(true)
+
+caster:set_input(field)
+caster:set_color_table(lut)
+caster:set_image_size(600, 400)
+caster:set_density(20.0)
+
+local start = os.clock()
+caster:write_ppm("raycast.ppm")
+print(string.format("cast 600x400 rays in %f seconds of cpu", os.clock() - start))
+
+image:set_data("image", caster)
+window:set_color(0.2, 0.2, 0.2)
+
+local angle = 0
+window:set_callback("r", function()
+   angle = angle + 15
+   caster:set_orientation(9, angle, 0)
+end, "rotate the camera")
+
+while window:render_scene{image} == "continue" do end
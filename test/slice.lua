@@ -0,0 +1,61 @@
+
+
+local luview = require 'luview'
+local shaders = require 'shaders'
+local fields = require 'fields'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local image = luview.ImagePlane()
+local field = luview.DataSource()
+local slice = luview.SliceSource()
+local pyluts = luview.MatplotlibColormaps()
+local cmshade = shaders.load_shader("cbar")
+
+-- a standing wave inside a spherical envelope
+local rho = fields.sample(64, function(x, y, z)
+   local r2 = x*x + y*y + z*z
+   return math.exp(-r2/0.05) * math.cos(20*x) * math.cos(14*y) * math.cos(8*z)
+end)
+
+field:set_mode("luminance")
+field:set_data(rho)
+
+slice:set_input(field)
+slice:set_size(1.0, 1.0)
+slice:set_resolution(300, 300)
+slice:set_normalize(true)
+
+image:set_data("image", slice)
+image:set_data("color_table", pyluts)
+image:set_shader(cmshade)
+
+box:set_color(0.5, 0.9, 0.9)
+window:set_color(0.2, 0.2, 0.2)
+
+-- the image is drawn where the slice was taken from
+local function update()
+   local cx, cy, cz = slice:get_center()
+   local ox, oy, oz = slice:get_orientation()
+   image:set_position(cx, cy, cz)
+   image:set_orientation(ox, oy, oz)
+end
+local function move(dz)
+   local cx, cy, cz = slice:get_center()
+   slice:set_center(cx, cy, math.min(math.max(cz + dz, -0.5), 0.5))
+   update()
+end
+local function tilt(dx, dy)
+   local ox, oy, oz = slice:get_orientation()
+   slice:set_orientation(ox + dx, oy + dy, oz)
+   update()
+end
+
+window:set_callback("+", function() move( 0.02) end, "move the slice up")
+window:set_callback("-", function() move(-0.02) end, "move the slice down")
+window:set_callback("x", function() tilt(10, 0) end, "tilt the slice about x")
+window:set_callback("y", function() tilt(0, 10) end, "tilt the slice about y")
+window:set_callback("]", function() pyluts:next_colormap() end, "next colormap")
+window:set_callback("[", function() pyluts:prev_colormap() end, "previous colormap")
+
+while window:render_scene{box, image} == "continue" do end
@@ -0,0 +1,59 @@
+
+
+local luview = require 'luview'
+local lunum = require 'lunum'
+
+local window = luview.Window()
+local box = luview.BoundingBox()
+local field = luview.DataSource()
+local seeds = luview.PointsSource()
+local lines = luview.StreamlineSource()
+local segments = luview.SegmentsEnsemble()
+
+-- an ABC flow, whose field lines are partly chaotic
+local N = 48
+local B = lunum.zeros{N,N,N,3}
+local A, Bc, C = 1.0, math.sqrt(2/3), math.sqrt(1/3)
+for m=0,N*N*N-1 do
+   local i, j, k = math.floor(m/(N*N)), math.floor(m/N) % N, m % N
+   local x = 2*math.pi*(k + 0.5)/N
+   local y = 2*math.pi*(j + 0.5)/N
+   local z = 2*math.pi*(i + 0.5)/N
+   B[3*m+0] = A*math.sin(z) + C*math.cos(y)
+   B[3*m+1] = Bc*math.sin(x) + A*math.cos(z)
+   B[3*m+2] = C*math.sin(y) + Bc*math.cos(x)
+end
+field:set_data(B)
+
+local offset = 0.0
+local function place_seeds()
+   local Ns = 2000
+   local X = lunum.zeros{Ns,3}
+   for n=0,Ns-1 do
+      local t = n/Ns
+      X[3*n+0] = 0.4*math.cos(2*math.pi*(t + offset))
+      X[3*n+1] = 0.4*math.sin(2*math.pi*(t + offset))
+      X[3*n+2] = 0.8*(t - 0.5)
+   end
+   seeds:set_points(X)
+end
+place_seeds()
+
+lines:set_input(field)
+lines:set_seeds(seeds)
+lines:set_max_length(0.5)
+
+segments:set_data("segments", lines)
+segments:set_color(1.0, 0.8, 0.2)
+window:set_color(0.1, 0.1, 0.1)
+
+window:set_callback("m", function()
+   offset = offset + 0.01
+   local start = os.clock()
+   place_seeds()
+   lines:compile()
+   print(string.format("traced 2000 seeds in %f seconds of cpu",
+                       os.clock() - start))
+end, "move the seeds")
+
+while window:render_scene{box, segments} == "continue" do end
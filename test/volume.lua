@@ -1,22 +1,39 @@
 
 
-
 local luview = require 'luview'
-local lunum = require 'lunum'
 local shaders = require 'shaders'
+local fields = require 'fields'
 
 local window = luview.Window()
 local box = luview.BoundingBox()
 local volume = luview.VolumeRendering()
+local field = luview.DataSource()
+local lut = luview.DataSource()
 local shader = shaders.load_shader("lambertian")
 
+-- two nested shells, the space around and between them empty
+local rho = fields.sample(64, function(x, y, z)
+   local r = math.sqrt(x*x + y*y + z*z)
+   return math.exp(-((r - 0.15)/0.03)^2) + 0.5*math.exp(-((r - 0.35)/0.02)^2)
+end)
+
+lut:set_mode("rgba")
+lut:set_data(fields.ramp(0.1))
+
+field:set_mode("luminance")
+field:set_data(rho)
+field:set_normalize(true)
 
 window:set_color(0.2, 0.2, 0.2)
 box:set_color(0.5, 0.9, 0.9)
 box:set_shader(shader)
---volume:set_scale(0.8, 0.8, 0.8)
+volume:set_data("volume", field)
+volume:set_data("color_table", lut)
+volume:set_density(20.0)
+
+window:set_callback("+", function()
+   volume:set_density(volume:get_density() * 1.5) end, "denser")
+window:set_callback("-", function()
+   volume:set_density(volume:get_density() / 1.5) end, "thinner")
 
-local cycle = 0
-while window:render_scene{volume} == "continue" do
-   cycle = cycle + 1
-end
+while window:render_scene{box, volume} == "continue" do end